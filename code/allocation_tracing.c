@@ -0,0 +1,191 @@
+#include "allocation_tracing.h"
+#include "common_data_types.h"
+#include <stdatomic.h>
+#include <stdio.h>
+
+#if defined(T_TRACE_ALLOCATIONS)
+
+
+// Everything we know about the allocations under one tag.
+struct AllocationTrace
+{
+  // How many allocations were there?
+  atomic_size_t allocations_w;
+
+  // How many bytes did they add up to?
+  atomic_size_t allocated_w;
+
+  // How wide was the widest one?
+  atomic_size_t widest_allocation_w;
+
+  // How many allocations landed in each size bucket?
+  atomic_size_t bucket_allocations_w[allocation_size_buckets_w];
+};
+
+
+Size AllocationSizeBucket(Size allocation_w);
+
+void RaiseAtomically(atomic_size_t *maximum, Size value);
+
+
+static const Text allocation_tag_names[allocation_tags_w] =
+{
+  [UntaggedAllocation] = "untagged",
+  [SourceTextAllocation] = "source text",
+  [LineIndexAllocation] = "line index",
+  [TokenTextAllocation] = "token text",
+  [TokenArrayAllocation] = "token arrays",
+  [DiagnosticAllocation] = "diagnostics",
+  [EnumResolutionAllocation] = "enum resolution",
+  [PipelineBatchAllocation] = "pipeline batches",
+  [FileLoadingAllocation] = "file loading",
+  [CompilationCacheAllocation] = "compilation cache",
+  [WatchingAllocation] = "watching",
+  [RecycledBlockAllocation] = "recycled blocks",
+  [LineMemoAllocation] = "line memo",
+  [TraceEventAllocation] = "trace events"
+};
+
+/*
+  Allocators are used on many threads at once, so every counter
+  is atomic. (We only ever add to them, so "relaxed" ordering is
+  all we need.)
+*/
+static struct AllocationTrace allocation_traces[allocation_tags_w];
+
+// What's the most any single allocator has had allocated at once?
+static atomic_size_t peak_arena_allocated_w;
+
+
+// Makes a note of an allocation. (See 'TaggedAllocate'.)
+void TraceAllocation(
+  // What's the allocation for?
+  enum AllocationTag tag,
+  // How wide is it?
+  Size allocation_w,
+  // How many bytes has its allocator allocated, including this?
+  Size arena_allocated_w)
+{
+  auto trace = &allocation_traces[tag];
+
+  atomic_fetch_add_explicit(&trace->allocations_w, 1, memory_order_relaxed);
+
+  atomic_fetch_add_explicit(
+    &trace->allocated_w,
+    allocation_w,
+    memory_order_relaxed);
+
+  atomic_fetch_add_explicit(
+    &trace->bucket_allocations_w[AllocationSizeBucket(allocation_w)],
+    1,
+    memory_order_relaxed);
+
+  RaiseAtomically(&trace->widest_allocation_w, allocation_w);
+  RaiseAtomically(&peak_arena_allocated_w, arena_allocated_w);
+}
+
+
+/*
+  Writes what we know about every tag that saw any allocations:
+  how many, how many bytes, and how they were spread across size
+  buckets.
+*/
+void ReportAllocations(FILE *stream)
+{
+  fprintf(stream, "Allocations:\n");
+
+  for (Offset tag = 0; tag < allocation_tags_w; tag++)
+  {
+    auto trace = &allocation_traces[tag];
+    auto allocations_w = atomic_load(&trace->allocations_w);
+
+    if (allocations_w == 0)
+    {
+      continue;
+    }
+
+    fprintf(
+      stream,
+      "  %s: %zu allocations, %zu bytes (widest: %zu bytes)\n",
+      allocation_tag_names[tag],
+      allocations_w,
+      atomic_load(&trace->allocated_w),
+      atomic_load(&trace->widest_allocation_w));
+
+    for (Offset bucket = 0; bucket < allocation_size_buckets_w; bucket++)
+    {
+      auto bucket_allocations_w =
+        atomic_load(&trace->bucket_allocations_w[bucket]);
+
+      if (bucket_allocations_w == 0)
+      {
+        continue;
+      }
+
+      // (Bucket 0 only holds empty allocations.)
+      auto widest_in_bucket_w =
+        (bucket == 0) ? 0 : (Size) 1 << (bucket - 1);
+
+      fprintf(
+        stream,
+        "    Up to %zu bytes: %zu\n",
+        widest_in_bucket_w,
+        bucket_allocations_w);
+    }
+  }
+
+  fprintf(
+    stream,
+    "  Peak arena usage: %zu bytes\n",
+    atomic_load(&peak_arena_allocated_w));
+}
+
+
+/*
+  Which size bucket does an allocation this wide go in?
+
+  (That's how many bits it takes to write 'allocation_w - 1',
+  plus one. Empty allocations get a bucket of their own.)
+*/
+Size AllocationSizeBucket(Size allocation_w)
+{
+  if (allocation_w == 0)
+  {
+    return 0;
+  }
+
+  Size bucket = 1;
+
+  for (auto remaining_w = allocation_w - 1; remaining_w > 0; remaining_w >>= 1)
+  {
+    bucket += 1;
+  }
+
+  // (No allocator could ever hand out 2^64 bytes, but just in
+  // case, the last bucket holds everything wider.)
+  if (bucket >= allocation_size_buckets_w)
+  {
+    bucket = allocation_size_buckets_w - 1;
+  }
+
+  return bucket;
+}
+
+
+// If the value is bigger than the maximum, it's the new maximum.
+void RaiseAtomically(atomic_size_t *maximum, Size value)
+{
+  auto current = atomic_load_explicit(maximum, memory_order_relaxed);
+
+  while (value > current
+         && !atomic_compare_exchange_weak_explicit(
+           maximum,
+           &current,
+           value,
+           memory_order_relaxed,
+           memory_order_relaxed))
+  {
+  }
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef allocation_tracing_h_already_included
+#define allocation_tracing_h_already_included
+
+#include "common_data_types.h"
+#include <stdio.h>
+
+
+/*
+  What is this allocation for?
+
+  When the compiler is built with allocation tracing (see
+  'T_TRACE_ALLOCATIONS' in "CMakeLists.txt"), every allocation is
+  counted under the tag its caller provided. (See
+  'TaggedAllocate'.)
+*/
+enum AllocationTag
+{
+  UntaggedAllocation,
+  SourceTextAllocation,
+  LineIndexAllocation,
+  TokenTextAllocation,
+  TokenArrayAllocation,
+  DiagnosticAllocation,
+  EnumResolutionAllocation,
+  PipelineBatchAllocation,
+  FileLoadingAllocation,
+  CompilationCacheAllocation,
+  WatchingAllocation,
+  RecycledBlockAllocation,
+  LineMemoAllocation,
+  TraceEventAllocation,
+
+  // (This isn't a tag. It's how many tags there are.)
+  allocation_tags_w
+};
+
+/*
+  We sort allocations into buckets by size: the first bucket
+  holds empty allocations, and bucket N holds allocations up to
+  2^(N-1) bytes wide that don't fit in bucket N-1.
+*/
+constexpr Size allocation_size_buckets_w = 65;
+
+#if defined(T_TRACE_ALLOCATIONS)
+
+void TraceAllocation(
+  enum AllocationTag tag,
+  Size allocation_w,
+  Size arena_allocated_w);
+
+void ReportAllocations(FILE *stream);
+
+#endif
+
+#endif
@@ -0,0 +1,282 @@
+#include "batch_compiling.h"
+#include "block_recycling.h"
+#include "common_data_types.h"
+#include "compiling.h"
+#include "event_tracing.h"
+#include "exit_due_to_error.h"
+#include "file_loading.h"
+#include "line_memo.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+
+// We never start more worker threads than this.
+constexpr Size max_worker_threads_w = 64;
+
+// How many blocks can the workers use at once, in total?
+constexpr Size max_recycled_blocks_w = 4096;
+
+// How much memory can the batch's bookkeeping use, at most?
+constexpr Size max_bookkeeping_w = 1024 * 1024 * 1024;
+
+// One T source file in a batch, and its results.
+struct BatchedFile
+{
+  Text filename;
+
+  // Everything the compiler wrote while compiling the file.
+  Character *result;
+  Size result_w;
+
+  enum CompilationOutcome outcome;
+};
+
+// Everything the worker threads share.
+struct Batch
+{
+  struct BatchedFile *files;
+  Size files_w;
+
+  /*
+    Loads the files ahead of the workers. Its files line up with
+    ours, but they're loaded in whatever order they're ready.
+  */
+  struct FileLoader *loader;
+
+  // Where the workers' allocators get their memory.
+  struct BlockRecycler *recycler;
+
+  /*
+    Lines the workers have tokenized so far, in any file. Files
+    in a batch often share lines (like license headers), so each
+    one only needs tokenizing once.
+  */
+  struct LineMemo *memo;
+};
+
+
+Integer CompileBatchedFiles(Memory batch);
+
+enum CompilationOutcome ReportUnloadedFile(
+  const struct LoadedFile *file,
+  FILE *output);
+
+Size WorkerThreadsToStart(Size files_w);
+
+
+/*
+  Compiles many T source files at once, spread across several
+  worker threads. Afterward, we write each file's results, in
+  order, under a little header.
+
+  A broken file doesn't stop the others from compiling.
+
+  Returns our program's exit status.
+*/
+Integer CompileTSourceFiles(Text filenames[], Size filenames_w)
+{
+  static struct BlockRecycler recycler;
+  InitializeBlockRecycler(&recycler, max_recycled_blocks_w);
+
+  // The batch's bookkeeping only uses the memory it needs.
+  auto allocator = ReservedAllocator(max_bookkeeping_w, false);
+
+  auto memo = LineMemo(&allocator);
+
+  // Start loading files right away, so the workers never have to
+  // wait for the disk.
+  static struct FileLoader loader;
+  StartLoadingFiles(&loader, filenames, filenames_w, &allocator);
+
+  struct Batch batch =
+  {
+    .files = TaggedAllocate(
+      &allocator,
+      filenames_w * sizeof (struct BatchedFile),
+      FileLoadingAllocation),
+    .files_w = filenames_w,
+    .loader = &loader,
+    .recycler = &recycler,
+    .memo = &memo
+  };
+
+  for (Offset i = 0; i < filenames_w; i++)
+  {
+    batch.files[i] = (struct BatchedFile) { .filename = filenames[i] };
+  }
+
+  // We count as a worker, too, so we start one fewer thread.
+  thrd_t workers[max_worker_threads_w];
+  auto workers_w = WorkerThreadsToStart(filenames_w) - 1;
+
+  for (Offset i = 0; i < workers_w; i++)
+  {
+    if (thrd_create(&workers[i], CompileBatchedFiles, &batch)
+        != thrd_success)
+    {
+      ExitDueToError("The compiler couldn’t start a worker thread.\n");
+    }
+  }
+
+  CompileBatchedFiles(&batch);
+
+  for (Offset i = 0; i < workers_w; i++)
+  {
+    thrd_join(workers[i], NULL);
+  }
+
+  FinishLoadingFiles(&loader);
+  ReleaseLineMemo(&memo);
+
+  // Write everyone's results, in order.
+  auto exit_status = EXIT_SUCCESS;
+
+  for (Offset i = 0; i < filenames_w; i++)
+  {
+    auto file = &batch.files[i];
+
+    // Like a regular run, problems go to the standard error
+    // stream.
+    auto destination = stdout;
+
+    if (file->outcome != CompilationSucceeded)
+    {
+      destination = stderr;
+      exit_status = EXIT_FAILURE;
+    }
+
+    fprintf(destination, "==> %s <==\n", file->filename);
+    fwrite(file->result, 1, file->result_w, destination);
+
+    free(file->result);
+  }
+
+  ReleaseReservedAllocator(&allocator);
+
+  return exit_status;
+}
+
+
+/*
+  A worker thread's job: keep compiling files from the batch as
+  they're loaded, until there are none left.
+
+  Each worker tokenizes with its own thread allocator, so workers
+  never wait on each other for memory.
+*/
+Integer CompileBatchedFiles(Memory batch_memory)
+{
+  struct Batch *batch = batch_memory;
+  auto tokenizing_allocator = ThreadAllocator(batch->recycler);
+  auto index_allocator = ReservedAllocator(max_t_source_w, false);
+
+  UseLineMemo(batch->memo);
+  NameTraceThread("Worker");
+
+  struct LoadedFile *loaded_file;
+
+  while ((loaded_file = NextLoadedFile(batch->loader)) != NULL)
+  {
+    auto file = &batch->files[loaded_file - batch->loader->files];
+
+    auto result_stream =
+      open_memstream(&file->result, &file->result_w);
+
+    if (result_stream == NULL)
+    {
+      ExitDueToError("The compiler couldn’t open a memory stream.\n");
+    }
+
+    if (loaded_file->error_number != 0)
+    {
+      file->outcome = ReportUnloadedFile(loaded_file, result_stream);
+    }
+    else
+    {
+      /*
+        (Tokenizing and rendering take turns, line by line, so we
+        trace them together. Tracing every line would cost too
+        much.)
+      */
+      BeginTraceEvent("Compile", file->filename);
+
+      file->outcome = CompileLoadedTSourceSafely(
+        loaded_file->text,
+        loaded_file->text_w,
+        result_stream,
+        &index_allocator,
+        tokenizing_allocator);
+
+      EndTraceEvent("Compile", file->filename);
+    }
+
+    ReleaseLoadedFile(loaded_file);
+
+    // Closing the memory stream finalizes the file's result.
+    fclose(result_stream);
+  }
+
+  UseLineMemo(NULL);
+
+  // Our blocks can go to whoever needs them next.
+  ReleaseThreadAllocator();
+  ReleaseReservedAllocator(&index_allocator);
+
+  return 0;
+}
+
+
+/*
+  Writes the same error message that compiling the file directly
+  would have, had it failed to load.
+*/
+enum CompilationOutcome ReportUnloadedFile(
+  const struct LoadedFile *file,
+  FILE *output)
+{
+  if (file->opened == false)
+  {
+    fprintf(
+      output,
+      "The compiler couldn’t open your source file: '%s'\n"
+      "Underlying error message: %s\n",
+      file->filename,
+      strerror(file->error_number));
+
+    return CompilationSourceUnavailable;
+  }
+
+  fprintf(
+    output,
+    "The compiler couldn’t read your source code.\n"
+    "Underlying error message: %s\n",
+    strerror(file->error_number));
+
+  return CompilationFailed;
+}
+
+
+// How many threads (including ours) should compile the batch?
+Size WorkerThreadsToStart(Size files_w)
+{
+  // One per processor...
+  auto processors_w = sysconf(_SC_NPROCESSORS_ONLN);
+  Size workers_w = (processors_w > 0) ? (Size) processors_w : 1;
+
+  // ... but no more than we need.
+  if (workers_w > files_w)
+  {
+    workers_w = files_w;
+  }
+
+  if (workers_w > max_worker_threads_w)
+  {
+    workers_w = max_worker_threads_w;
+  }
+
+  return workers_w;
+}
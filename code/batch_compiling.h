@@ -0,0 +1,9 @@
+#ifndef batch_compiling_h_already_included
+#define batch_compiling_h_already_included
+
+#include "common_data_types.h"
+
+
+Integer CompileTSourceFiles(Text filenames[], Size filenames_w);
+
+#endif
@@ -0,0 +1,394 @@
+#include "block_recycling.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+#include "memory.h"
+#include <stdatomic.h>
+#include <threads.h>
+
+
+/*
+  Each block a recycling allocator uses starts with a little
+  header: the address of the block it used before this one. That
+  way, the allocator can find (and give back) all its blocks.
+
+  (We make the header 16 bytes wide so allocations that follow it
+  start nicely aligned.)
+*/
+constexpr Size block_header_w = 16;
+
+// The lower 32 bits of the free list's head.
+constexpr uint64_t free_list_index_mask = 0xFFFF'FFFF;
+
+// Every thread's very own allocator. (See 'ThreadAllocator'.)
+static thread_local struct Allocator thread_allocator = {};
+
+// Every recycler we've prepared. (See 'ReportBlockRecycling'.)
+static struct BlockRecycler *first_recycler = NULL;
+
+
+uint64_t NextFreeListTag(uint64_t free_list_head);
+
+Offset BlockOffset(
+  const struct BlockRecycler *recycler,
+  Memory block);
+
+Memory *PreviousBlock(Memory block);
+
+
+/*
+  Prepares a recycler that can hand out up to 'max_blocks_w'
+  blocks at once.
+
+  We only reserve the memory up front. Blocks are committed one
+  at a time, the first time they're needed.
+
+  (Call this before any other thread uses the recycler.)
+*/
+void InitializeBlockRecycler(
+  struct BlockRecycler *recycler,
+  Size max_blocks_w)
+{
+  // The free list can only count so high.
+  if (max_blocks_w >= free_list_index_mask)
+  {
+    ExitDueToError(
+      "A block recycler can’t manage %zu blocks.\n",
+      max_blocks_w);
+  }
+
+  auto next_free_blocks_w =
+    max_blocks_w * sizeof recycler->next_free_blocks[0];
+
+  /*
+    We reserve room for the blocks themselves, plus the list of
+    next free blocks, plus some padding so the first block starts
+    on a block boundary.
+  */
+  auto blocks_w = max_blocks_w * recycled_block_w;
+
+  recycler->blocks = ReservedAllocator(
+    next_free_blocks_w + recycled_block_w + blocks_w,
+    false);
+
+  recycler->next_free_blocks =
+    TaggedAllocate(
+      &recycler->blocks,
+      next_free_blocks_w,
+      RecycledBlockAllocation);
+
+  // Skip ahead to the block boundary.
+  auto padding_w =
+    (recycled_block_w - (next_free_blocks_w % recycled_block_w))
+    % recycled_block_w;
+
+  TaggedAllocate(
+    &recycler->blocks,
+    padding_w,
+    RecycledBlockAllocation);
+
+  recycler->first_block = NextAddressToAllocate(&recycler->blocks);
+
+  mtx_init(&recycler->blocks_mutex, mtx_plain);
+
+  recycler->max_blocks_w = max_blocks_w;
+  atomic_init(&recycler->free_list_head, 0);
+  atomic_init(&recycler->blocks_in_use_w, 0);
+  atomic_init(&recycler->blocks_recycled_w, 0);
+
+  // (A recycler that's prepared again is already on the list.)
+  for (auto listed = first_recycler;
+       listed != NULL;
+       listed = listed->next_recycler)
+  {
+    if (listed == recycler)
+    {
+      return;
+    }
+  }
+
+  recycler->next_recycler = first_recycler;
+  first_recycler = recycler;
+}
+
+
+/*
+  Returns a block of 'recycled_block_w' bytes.
+
+  If another thread gave a block back, we reuse it. Otherwise, we
+  carve out a brand new one.
+*/
+Memory TakeBlock(struct BlockRecycler *recycler)
+{
+  auto free_list_head = atomic_load_explicit(
+    &recycler->free_list_head,
+    memory_order_acquire);
+
+  // While the free list isn't empty...
+  while ((free_list_head & free_list_index_mask) != 0)
+  {
+    // ... let's try to pop its first block.
+    auto block_o = (free_list_head & free_list_index_mask) - 1;
+
+    auto next_free_block = atomic_load_explicit(
+      &recycler->next_free_blocks[block_o],
+      memory_order_relaxed);
+
+    auto new_free_list_head =
+      NextFreeListTag(free_list_head) | next_free_block;
+
+    /*
+      If nobody changed the head in the meantime, we now own the
+      block. Otherwise, 'free_list_head' is updated to the latest
+      head, and we try again.
+    */
+    if (atomic_compare_exchange_weak_explicit(
+          &recycler->free_list_head,
+          &free_list_head,
+          new_free_list_head,
+          memory_order_acquire,
+          memory_order_acquire))
+    {
+      atomic_fetch_add_explicit(
+        &recycler->blocks_in_use_w,
+        1,
+        memory_order_relaxed);
+
+      atomic_fetch_add_explicit(
+        &recycler->blocks_recycled_w,
+        1,
+        memory_order_relaxed);
+
+      return (Byte*) recycler->first_block + block_o * recycled_block_w;
+    }
+  }
+
+  // The free list is empty. Let's carve out a brand new block.
+  mtx_lock(&recycler->blocks_mutex);
+
+  auto carved_blocks_w = BlockOffset(
+    recycler,
+    NextAddressToAllocate(&recycler->blocks));
+
+  if (carved_blocks_w == recycler->max_blocks_w)
+  {
+    mtx_unlock(&recycler->blocks_mutex);
+
+    ExitDueToError(
+      "The block recycler ran out of blocks! (It has %zu.)\n",
+      recycler->max_blocks_w);
+  }
+
+  auto block = TaggedAllocate(
+    &recycler->blocks,
+    recycled_block_w,
+    RecycledBlockAllocation);
+
+  mtx_unlock(&recycler->blocks_mutex);
+
+  atomic_fetch_add_explicit(
+    &recycler->blocks_in_use_w,
+    1,
+    memory_order_relaxed);
+
+  return block;
+}
+
+
+// Gives a block back, so any thread can reuse it.
+void RecycleBlock(struct BlockRecycler *recycler, Memory block)
+{
+  auto block_o = BlockOffset(recycler, block);
+
+  auto free_list_head = atomic_load_explicit(
+    &recycler->free_list_head,
+    memory_order_relaxed);
+
+  uint64_t new_free_list_head;
+
+  // Push the block onto the front of the free list.
+  do
+  {
+    atomic_store_explicit(
+      &recycler->next_free_blocks[block_o],
+      free_list_head & free_list_index_mask,
+      memory_order_relaxed);
+
+    new_free_list_head =
+      NextFreeListTag(free_list_head) | (block_o + 1);
+  }
+  while (atomic_compare_exchange_weak_explicit(
+           &recycler->free_list_head,
+           &free_list_head,
+           new_free_list_head,
+           memory_order_release,
+           memory_order_relaxed) == false);
+
+  atomic_fetch_sub_explicit(
+    &recycler->blocks_in_use_w,
+    1,
+    memory_order_relaxed);
+}
+
+
+/*
+  Returns a new arena allocator whose memory comes from the
+  provided recycler, one block at a time.
+
+  Each allocation must fit within a single block.
+*/
+struct Allocator RecyclingAllocator(struct BlockRecycler *recycler)
+{
+  auto block = TakeBlock(recycler);
+
+  // This is our first block. There's nothing before it.
+  *PreviousBlock(block) = NULL;
+
+  return (struct Allocator)
+  {
+    .memory = block,
+    .memory_w = recycled_block_w,
+    .allocated_w = block_header_w,
+    .committed_w = recycled_block_w,
+    .recycler = recycler
+  };
+}
+
+
+/*
+  Moves a recycling allocator on to a fresh block, provided the
+  allocation would fit.
+
+  Returns false if the allocation is too big for any block.
+*/
+YesNo MoveToFreshBlock(struct Allocator *allocator, Size allocation_w)
+{
+  if (allocation_w > recycled_block_w - block_header_w)
+  {
+    return false;
+  }
+
+  auto block = TakeBlock(allocator->recycler);
+
+  // Remember the block we're leaving behind.
+  *PreviousBlock(block) = allocator->memory;
+
+  allocator->memory = block;
+  allocator->allocated_w = block_header_w;
+
+  return true;
+}
+
+
+/*
+  Performs a factory reset on a recycling allocator.
+
+  We give back every block except the current one. (It's still
+  warm, so we'll keep using it.)
+*/
+void ResetRecyclingAllocator(struct Allocator *allocator)
+{
+  auto block = *PreviousBlock(allocator->memory);
+
+  while (block != NULL)
+  {
+    auto previous_block = *PreviousBlock(block);
+    RecycleBlock(allocator->recycler, block);
+    block = previous_block;
+  }
+
+  *PreviousBlock(allocator->memory) = NULL;
+  allocator->allocated_w = block_header_w;
+}
+
+
+// Gives back every block a recycling allocator is using. The
+// allocator can't be used afterward.
+void RecycleEveryBlock(struct Allocator *allocator)
+{
+  ResetRecyclingAllocator(allocator);
+  RecycleBlock(allocator->recycler, allocator->memory);
+
+  *allocator = (struct Allocator) {};
+}
+
+
+/*
+  Returns the current thread's very own recycling allocator.
+
+  The first time a thread asks, we create it. Before the thread
+  finishes, it should call 'ReleaseThreadAllocator'.
+*/
+struct Allocator *ThreadAllocator(struct BlockRecycler *recycler)
+{
+  if (thread_allocator.recycler == NULL)
+  {
+    thread_allocator = RecyclingAllocator(recycler);
+  }
+
+  return &thread_allocator;
+}
+
+
+// Gives back every block the current thread's allocator is using.
+void ReleaseThreadAllocator()
+{
+  if (thread_allocator.recycler != NULL)
+  {
+    RecycleEveryBlock(&thread_allocator);
+  }
+}
+
+
+/*
+  Reports how each recycler did: how many blocks it carved out,
+  how many times it reused one instead, and how many are still in
+  use. (We call this on our way out, once every thread is done.)
+*/
+void ReportBlockRecycling(FILE *stream)
+{
+  for (auto recycler = first_recycler;
+       recycler != NULL;
+       recycler = recycler->next_recycler)
+  {
+    auto carved_w = BlockOffset(
+      recycler,
+      NextAddressToAllocate(&recycler->blocks));
+
+    // (It never needed a block.)
+    if (carved_w == 0)
+    {
+      continue;
+    }
+
+    fprintf(
+      stream,
+      "  Recycled blocks: %zu carved, %zu reused, %zu still in use\n",
+      carved_w,
+      atomic_load(&recycler->blocks_recycled_w),
+      atomic_load(&recycler->blocks_in_use_w));
+  }
+}
+
+
+// Returns the free list head's tag, plus one, in the upper bits.
+uint64_t NextFreeListTag(uint64_t free_list_head)
+{
+  return ((free_list_head >> 32) + 1) << 32;
+}
+
+
+// Which block is this? (0 is the first block, and so on.)
+Offset BlockOffset(
+  const struct BlockRecycler *recycler,
+  Memory block)
+{
+  return ((Byte*) block - (Byte*) recycler->first_block)
+    / recycled_block_w;
+}
+
+
+// Where in this block is the address of the block before it?
+Memory *PreviousBlock(Memory block)
+{
+  return block;
+}
@@ -0,0 +1,87 @@
+#ifndef block_recycling_h_already_included
+#define block_recycling_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <threads.h>
+
+
+// Every recycled block is this many bytes wide.
+constexpr Size recycled_block_w = 256 * 1024;
+
+/*
+  A shared pool of equally-sized blocks of memory, safe to use
+  from many threads at once.
+
+  Each thread gets its own arena allocator (see
+  'RecyclingAllocator' and 'ThreadAllocator'), so allocating
+  never involves other threads. Only when an arena needs another
+  block, or gives its blocks back, does it touch this pool.
+
+  Returned blocks go onto a lock-free "free list". Other threads
+  take them off again without asking the operating system for
+  anything.
+*/
+struct BlockRecycler
+{
+  // Brand new blocks are carved out of this reserved allocator.
+  struct Allocator blocks;
+  mtx_t blocks_mutex;
+
+  // Where does the very first block start?
+  Memory first_block;
+
+  /*
+    The free list is a "Treiber stack": a linked list whose head
+    we only ever change with a compare-and-swap.
+
+    The lower 32 bits of the head hold (1 + the index of the first
+    free block), or 0 if the list is empty. The upper 32 bits hold
+    a tag that changes with every update, so a compare-and-swap
+    can't be fooled by a head that was popped and pushed back in
+    the meantime. (That's the "ABA problem".)
+  */
+  _Atomic uint64_t free_list_head;
+
+  // For each block, (1 + the index of the next free block).
+  _Atomic uint32_t *next_free_blocks;
+
+  // How many blocks can we carve, in total?
+  Size max_blocks_w;
+
+  // How many blocks are being used by arenas right now?
+  atomic_size_t blocks_in_use_w;
+
+  // How many times was a block reused from the free list?
+  atomic_size_t blocks_recycled_w;
+
+  // (Every recycler is on a list, so we can report on it. See
+  // 'ReportBlockRecycling'.)
+  struct BlockRecycler *next_recycler;
+};
+
+void InitializeBlockRecycler(
+  struct BlockRecycler *recycler,
+  Size max_blocks_w);
+
+Memory TakeBlock(struct BlockRecycler *recycler);
+
+void RecycleBlock(struct BlockRecycler *recycler, Memory block);
+
+struct Allocator RecyclingAllocator(struct BlockRecycler *recycler);
+
+YesNo MoveToFreshBlock(struct Allocator *allocator, Size allocation_w);
+
+void ResetRecyclingAllocator(struct Allocator *allocator);
+
+void RecycleEveryBlock(struct Allocator *allocator);
+
+struct Allocator *ThreadAllocator(struct BlockRecycler *recycler);
+
+void ReleaseThreadAllocator();
+
+void ReportBlockRecycling(FILE *stream);
+
+#endif
@@ -0,0 +1,139 @@
+#include "compilation_cache.h"
+#include "common_data_types.h"
+#include "memory.h"
+#include "text.h"
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__APPLE__)
+  // Apple calls the modification time something else.
+  #define st_mtim st_mtimespec
+#endif
+
+
+YesNo IsSameVersionOfFile(
+  const struct stat *file_status,
+  const struct stat *other_file_status);
+
+
+// Prepares an empty cache, provided an allocator for the cache
+// to control.
+void InitializeCompilationCache(
+  struct CompilationCache *cache,
+  struct Allocator allocator)
+{
+  cache->compilations_w = 0;
+  cache->allocator = allocator;
+}
+
+
+/*
+  Returns the cached compilation of this version of the file, if
+  we have one. Otherwise, returns NULL.
+*/
+const struct CachedCompilation *CachedCompilation(
+  const struct CompilationCache *cache,
+  // Which file are we looking for?
+  Text filename,
+  // What does the file look like right now?
+  const struct stat *file_status)
+{
+  for (Offset i = 0; i < cache->compilations_w; i++)
+  {
+    auto compilation = &cache->compilations[i];
+
+    if (strcmp(compilation->filename, filename) == 0
+        && IsSameVersionOfFile(&compilation->file_status, file_status))
+    {
+      return compilation;
+    }
+  }
+
+  return NULL;
+}
+
+
+// Remembers the result of compiling this version of the file.
+void CacheCompilation(
+  struct CompilationCache *cache,
+  // Which file did we compile?
+  Text filename,
+  // What did the file look like when we compiled it?
+  const struct stat *file_status,
+  // What did the compiler write?
+  Text result,
+  Size result_w,
+  // Did the compilation succeed?
+  YesNo succeeded)
+{
+  auto filename_w = strlen(filename);
+
+  // How many bytes do we need? (We add 1 for the filename's null
+  // terminator byte.)
+  auto needed_w = filename_w + 1 + result_w;
+
+  // If this result could never fit, we won't even try.
+  if (needed_w > cache->allocator.memory_w)
+  {
+    return;
+  }
+
+  // Forget any older compilations of the same file.
+  for (Offset i = 0; i < cache->compilations_w; i++)
+  {
+    if (strcmp(cache->compilations[i].filename, filename) == 0)
+    {
+      // Fill the gap with the final compilation.
+      cache->compilations_w -= 1;
+      cache->compilations[i] =
+        cache->compilations[cache->compilations_w];
+      break;
+    }
+  }
+
+  // If we're out of slots or memory, let's start over.
+  auto available_w =
+    cache->allocator.memory_w - cache->allocator.allocated_w;
+
+  if (cache->compilations_w == max_cached_compilations
+      || needed_w > available_w)
+  {
+    cache->compilations_w = 0;
+    ResetAllocator(&cache->allocator);
+  }
+
+  cache->compilations[cache->compilations_w] =
+    (struct CachedCompilation)
+    {
+      .filename = CopyTextSnippet(
+        filename,
+        0,
+        filename_w,
+        &cache->allocator,
+        CompilationCacheAllocation),
+      .file_status = *file_status,
+      .result = TaggedAllocateCopy(
+        &cache->allocator,
+        (Memory) result,
+        result_w,
+        CompilationCacheAllocation),
+      .result_w = result_w,
+      .succeeded = succeeded
+    };
+
+  cache->compilations_w += 1;
+}
+
+
+// Do these two file statuses describe the same version of a file?
+YesNo IsSameVersionOfFile(
+  const struct stat *file_status,
+  const struct stat *other_file_status)
+{
+  return
+       file_status->st_dev == other_file_status->st_dev
+    && file_status->st_ino == other_file_status->st_ino
+    && file_status->st_size == other_file_status->st_size
+    && file_status->st_mtim.tv_sec == other_file_status->st_mtim.tv_sec
+    && file_status->st_mtim.tv_nsec == other_file_status->st_mtim.tv_nsec;
+}
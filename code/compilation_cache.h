@@ -0,0 +1,69 @@
+#ifndef compilation_cache_h_already_included
+#define compilation_cache_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+#include <sys/stat.h>
+
+
+/*
+  The results of compiling one T source file, remembered so we
+  don't have to compile it again until the file changes.
+*/
+struct CachedCompilation
+{
+  // Which file did we compile?
+  Text filename;
+
+  // What did the file look like when we compiled it? (Its
+  // device, inode, size, and modification time tell us whether
+  // it has changed since.)
+  struct stat file_status;
+
+  // Everything the compiler wrote while compiling the file.
+  Text result;
+  Size result_w;
+
+  // Did the compilation succeed?
+  YesNo succeeded;
+};
+
+constexpr Size max_cached_compilations = 256;
+
+// How much memory do long-lived modes reserve for the cache?
+constexpr Size default_compilation_cache_w = 256 * 1024 * 1024;
+
+/*
+  A small cache of compilation results, used by the compiler's
+  long-lived modes (like "t --serve").
+
+  Every cached filename and result lives in the cache's own
+  allocator. When we run out of slots or memory, we simply forget
+  everything and start over; that's cheap, and it keeps the
+  cache's memory use bounded.
+*/
+struct CompilationCache
+{
+  struct CachedCompilation compilations[max_cached_compilations];
+  Size compilations_w;
+  struct Allocator allocator;
+};
+
+void InitializeCompilationCache(
+  struct CompilationCache *cache,
+  struct Allocator allocator);
+
+const struct CachedCompilation *CachedCompilation(
+  const struct CompilationCache *cache,
+  Text filename,
+  const struct stat *file_status);
+
+void CacheCompilation(
+  struct CompilationCache *cache,
+  Text filename,
+  const struct stat *file_status,
+  Text result,
+  Size result_w,
+  YesNo succeeded);
+
+#endif
@@ -0,0 +1,409 @@
+#include "compiling.h"
+#include "common_data_types.h"
+#include "diagnostics.h"
+#include "enum_resolving.h"
+#include "exit_due_to_error.h"
+#include "line_index.h"
+#include "line_memo.h"
+#include "memory.h"
+#include "text.h"
+#include "tokenizing.h"
+#include <errno.h>
+#include <setjmp.h>
+#include <stdio.h>
+
+
+Text LoadTSource(
+  FILE *t_source,
+  struct Allocator *allocator,
+  Size *source_w);
+
+enum CompilationOutcome CompileSafely(
+  Text filename,
+  FILE *t_source,
+  Text source,
+  Size source_w,
+  FILE *output,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator);
+
+
+/*
+  Compiles T source code, line by line, writing the results to
+  the provided output stream.
+
+  The source allocator holds the whole T source, along with its
+  line index. It must be a reserved allocator (see
+  'ReservedAllocator'), because the source has to be contiguous.
+
+  The tokenizing allocator only needs room to tokenize a single
+  line ('bytes_needed_to_tokenize_a_line').
+
+  We reset both allocators as we go, so a long-lived caller can
+  hand us the same warm allocators over and over again.
+*/
+void CompileTSource(
+  // Where do we read the T source code from?
+  FILE *t_source,
+  // Where do we write the results?
+  FILE *output,
+  // Our trusty allocators.
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator)
+{
+  ResetAllocator(source_allocator);
+
+  // Read the whole T source, then compile it.
+  Size source_w;
+  auto source = LoadTSource(t_source, source_allocator, &source_w);
+
+  CompileLoadedTSource(
+    source,
+    source_w,
+    output,
+    source_allocator,
+    tokenizing_allocator);
+}
+
+
+/*
+  Compiles T source code that's already in memory, writing the
+  results to the provided output stream.
+
+  The line index goes into the index allocator, which must be a
+  reserved allocator. (It's fine if the source lives there, too.)
+  So do any diagnostics, which we report once we're done (see
+  'FinishDiagnostics'), and the enum resolution pass (see
+  'EnumResolution').
+*/
+void CompileLoadedTSource(
+  // The T source code, which needn't be null-terminated.
+  Text source,
+  Size source_w,
+  // Where do we write the results?
+  FILE *output,
+  // Our trusty allocators.
+  struct Allocator *index_allocator,
+  struct Allocator *tokenizing_allocator)
+{
+  // Find where each line starts.
+  auto lines = LineIndex(source, source_w, index_allocator);
+
+  // If the tokenizer finds any problems, they go here.
+  auto diagnostics = Diagnostics(index_allocator);
+  CollectDiagnostics(&diagnostics);
+
+  // Each line goes through the enum resolution pass, too.
+  auto enums = EnumResolution(index_allocator);
+
+  for (Offset line_o = 0;
+       line_o < lines.lines_w && TooManyErrors(&diagnostics) == false;
+       line_o++)
+  {
+    auto line_number = line_o + 1;
+
+    /*
+      Q: Why do we reset the allocator each loop iteration?
+
+      A: Right now, we don't need to preserve any data between
+         iterations. Once we do, we'll need to use an allocator
+         that is preserved between iterations, too.
+    */
+    ResetAllocator(tokenizing_allocator);
+
+    // Have we tokenized an identical line before? (See
+    // 'UseLineMemo'.) If not, tokenize the current line.
+    auto line = Line(&lines, line_o);
+    auto line_w = LineWidth(&lines, line_o);
+    struct TokenizedLine tokenized_line;
+
+    if (RecallTokenizedLine(
+          line,
+          line_w,
+          tokenizing_allocator,
+          &tokenized_line) == false)
+    {
+      auto problems_w = diagnostics.errors_w + diagnostics.warnings_w;
+
+      tokenized_line = TokenizedIndexedLine(
+        &lines,
+        line_o,
+        line_number,
+        tokenizing_allocator);
+
+      // (Lines with problems need to report them every time.)
+      if (diagnostics.errors_w + diagnostics.warnings_w == problems_w)
+      {
+        MemorizeTokenizedLine(line, line_w, &tokenized_line);
+      }
+    }
+
+    ResolveEnums(&enums, &tokenized_line, line_number);
+
+    // Render the result!
+    Render(&tokenized_line, line_number, output);
+  }
+
+  // (If we gave up early, anything unfinished is no surprise.)
+  if (TooManyErrors(&diagnostics) == false)
+  {
+    FinishResolvingEnums(&enums);
+  }
+
+  RenderEnumResolution(&enums, output);
+
+  CollectDiagnostics(NULL);
+  FinishDiagnostics(&diagnostics);
+}
+
+
+/*
+  Tokenizes one line of an indexed source text. (0 is the first
+  line.)
+
+  The tokens go into the tokenizing allocator, which only needs
+  room for 'bytes_needed_to_tokenize_a_line'.
+*/
+struct TokenizedLine TokenizedIndexedLine(
+  const struct LineIndex *lines,
+  Offset line_o,
+  Offset line_number,
+  // Our trusty allocator.
+  struct Allocator *tokenizing_allocator)
+{
+  Text *token_slots = TaggedAllocate(
+    tokenizing_allocator,
+    max_tokens_per_line * sizeof (Text),
+    TokenArrayAllocation);
+
+  Character *token_text = TaggedAllocate(
+    tokenizing_allocator,
+    max_token_text_per_line_w,
+    TokenTextAllocation);
+
+  // (If we've already found too many errors, there's nothing to
+  // tokenize.)
+  struct TokenizedLine tokenized = {};
+
+  TokenizeLines(
+    lines,
+    line_o,
+    1,
+    line_number,
+    &tokenized,
+    token_slots,
+    token_text,
+    NULL,
+    NULL);
+
+  return tokenized;
+}
+
+
+/*
+  Reads the whole T source into the allocator, which must be a
+  reserved allocator. Returns the text, and writes its width to
+  'source_w'.
+
+  (The text isn't null-terminated.)
+*/
+Text LoadTSource(
+  FILE *t_source,
+  struct Allocator *allocator,
+  Size *source_w)
+{
+  // We read this many bytes at a time.
+  constexpr Size read_step_w = 64 * 1024;
+
+  Text source = NextAddressToAllocate(allocator);
+  *source_w = 0;
+
+  while (true)
+  {
+    auto step = TaggedAllocate(
+      allocator,
+      read_step_w,
+      SourceTextAllocation);
+    auto read_w = fread(step, 1, read_step_w, t_source);
+
+    *source_w += read_w;
+
+    // If we read less than we asked for, we've reached the end.
+    if (read_w < read_step_w)
+    {
+      GiveBackBytes(allocator, read_step_w - read_w);
+      break;
+    }
+  }
+
+  if (ferror(t_source))
+  {
+    ExitDueToError("The compiler couldn’t read your source code.\n");
+  }
+
+  return source;
+}
+
+
+/*
+  Just like 'CompileTSource', except errors don't exit the
+  program. Instead, the error message is written to the output
+  stream, too, and we report that the compilation failed.
+*/
+enum CompilationOutcome CompileTSourceSafely(
+  FILE *t_source,
+  FILE *output,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator)
+{
+  return CompileSafely(
+    NULL,
+    t_source,
+    NULL,
+    0,
+    output,
+    source_allocator,
+    tokenizing_allocator);
+}
+
+
+// Opens the T source file, then compiles it safely.
+enum CompilationOutcome CompileTSourceFileSafely(
+  Text filename,
+  FILE *output,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator)
+{
+  return CompileSafely(
+    filename,
+    NULL,
+    NULL,
+    0,
+    output,
+    source_allocator,
+    tokenizing_allocator);
+}
+
+
+// Just like 'CompileLoadedTSource', except errors don't exit the
+// program. (See 'CompileTSourceSafely'.)
+enum CompilationOutcome CompileLoadedTSourceSafely(
+  Text source,
+  Size source_w,
+  FILE *output,
+  struct Allocator *index_allocator,
+  struct Allocator *tokenizing_allocator)
+{
+  ResetAllocator(index_allocator);
+
+  return CompileSafely(
+    NULL,
+    NULL,
+    source,
+    source_w,
+    output,
+    index_allocator,
+    tokenizing_allocator);
+}
+
+
+/*
+  Compiles either the named T source file, the already-opened
+  stream, or the already-loaded source, catching any errors along
+  the way.
+*/
+enum CompilationOutcome CompileSafely(
+  // If this is NULL, we compile 't_source' instead.
+  Text filename,
+  // If this is NULL, too, we compile 'source' instead.
+  FILE *t_source,
+  Text source,
+  Size source_w,
+  FILE *output,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator)
+{
+  /*
+    If anything goes wrong, 'ExitDueToError' writes the error
+    message to our output, then jumps back to 'setjmp' below.
+
+    Any local variable we change after calling 'setjmp' must be
+    'volatile'. Otherwise, it might not survive the jump.
+  */
+  struct ErrorRecovery recovery = { .error_stream = output };
+  FILE *volatile t_source_file = NULL;
+  volatile enum CompilationOutcome outcome = CompilationFailed;
+
+  if (setjmp(recovery.landing_spot) == 0)
+  {
+    RecoverFromErrors(&recovery);
+
+    // Earlier compilations shouldn't leave their system errors
+    // behind.
+    errno = 0;
+
+    if (filename != NULL)
+    {
+      t_source_file = fopen(filename, "r");
+
+      if (t_source_file == NULL)
+      {
+        outcome = CompilationSourceUnavailable;
+
+        ExitDueToError(
+          "The compiler couldn’t open your source file: '%s'\n",
+          filename);
+      }
+
+      t_source = t_source_file;
+    }
+
+    if (t_source != NULL)
+    {
+      CompileTSource(
+        t_source,
+        output,
+        source_allocator,
+        tokenizing_allocator);
+    }
+    else
+    {
+      CompileLoadedTSource(
+        source,
+        source_w,
+        output,
+        source_allocator,
+        tokenizing_allocator);
+    }
+
+    outcome = CompilationSucceeded;
+  }
+
+  // (We land here either way.)
+  RecoverFromErrors(NULL);
+  CollectDiagnostics(NULL);
+
+  if (t_source_file != NULL)
+  {
+    fclose(t_source_file);
+  }
+
+  return outcome;
+}
+
+
+// Render a tokenized line for debug purposes.
+void Render(
+  const struct TokenizedLine *tokenized,
+  Offset line_number,
+  FILE *output)
+{
+  fprintf(output, "Line #%zu\n", line_number);
+  fprintf(output, "  Indent level: %zu\n", tokenized->indent_level);
+  fprintf(output, "  Token count: %zu\n", tokenized->tokens_w);
+
+  for (Offset i = 0; i < tokenized->tokens_w; i++)
+  {
+    fprintf(output, "    %s\n", tokenized->tokens[i]);
+  }
+}
@@ -0,0 +1,69 @@
+#ifndef compiling_h_already_included
+#define compiling_h_already_included
+
+#include "common_data_types.h"
+#include "line_index.h"
+#include "memory.h"
+#include "tokenizing.h"
+#include <stdio.h>
+
+
+// How big can a T source file (along with its line index) be?
+constexpr Size max_t_source_w = 4ull * 1024 * 1024 * 1024;
+
+/*
+  How did a "safe" compilation go? (Safe compilations never exit
+  the program.)
+*/
+enum CompilationOutcome
+{
+  CompilationSucceeded,
+  CompilationFailed,
+  // We couldn't even open the T source file.
+  CompilationSourceUnavailable
+};
+
+void CompileTSource(
+  FILE *t_source,
+  FILE *output,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator);
+
+void CompileLoadedTSource(
+  Text source,
+  Size source_w,
+  FILE *output,
+  struct Allocator *index_allocator,
+  struct Allocator *tokenizing_allocator);
+
+enum CompilationOutcome CompileTSourceSafely(
+  FILE *t_source,
+  FILE *output,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator);
+
+enum CompilationOutcome CompileTSourceFileSafely(
+  Text filename,
+  FILE *output,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator);
+
+enum CompilationOutcome CompileLoadedTSourceSafely(
+  Text source,
+  Size source_w,
+  FILE *output,
+  struct Allocator *index_allocator,
+  struct Allocator *tokenizing_allocator);
+
+struct TokenizedLine TokenizedIndexedLine(
+  const struct LineIndex *lines,
+  Offset line_o,
+  Offset line_number,
+  struct Allocator *tokenizing_allocator);
+
+void Render(
+  const struct TokenizedLine *tokenized,
+  Offset line_number,
+  FILE *output);
+
+#endif
@@ -0,0 +1,265 @@
+#include "diagnostics.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+#include "memory.h"
+#include <errno.h>
+#include <stdalign.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// How many errors can we report before we give up?
+static Size max_errors_w = default_max_errors_w;
+
+/*
+  If this thread is collecting diagnostics, this points to them.
+  Otherwise, it's NULL, and the first problem exits the program.
+*/
+static thread_local struct Diagnostics *diagnostics_collector = NULL;
+
+static const Text severity_names[] =
+{
+  [DiagnosticWarning] = "Warning",
+  [DiagnosticError] = "Error"
+};
+
+
+// This constructor prepares an empty collection of diagnostics.
+struct Diagnostics Diagnostics(
+  // Our trusty allocator.
+  struct Allocator *allocator)
+{
+  return (struct Diagnostics) { .allocator = allocator };
+}
+
+
+/*
+  From now on, diagnostics reported on this thread go into the
+  provided collection.
+
+  Pass NULL to go back to exiting at the first problem.
+*/
+void CollectDiagnostics(struct Diagnostics *diagnostics)
+{
+  diagnostics_collector = diagnostics;
+}
+
+
+/*
+  Reports a problem in the T source. We just make a note of it,
+  so it's up to the caller to carry on sensibly.
+
+  (Unless we aren't collecting diagnostics. Then, we exit the
+  program, just like 'ExitDueToError'.)
+*/
+void ReportDiagnostic(
+  // How bad is it?
+  enum DiagnosticSeverity severity,
+  // Where is it?
+  Offset line_number,
+  Offset column_number,
+  // What exactly went wrong? (Just like 'printf'.)
+  Text message_format,
+  ...)
+{
+  va_list variable_arguments;
+  va_start(variable_arguments, message_format);
+
+  auto diagnostics = diagnostics_collector;
+
+  if (diagnostics == NULL)
+  {
+    Character message[256];
+    vsnprintf(message, sizeof message, message_format, variable_arguments);
+    va_end(variable_arguments);
+
+    ExitDueToError(
+      "%s on line %zu, column %zu: %s\n",
+      severity_names[severity],
+      line_number,
+      column_number,
+      message);
+  }
+
+  // How wide is the message? (Measuring uses up the arguments,
+  // so we measure a copy.)
+  va_list measured_arguments;
+  va_copy(measured_arguments, variable_arguments);
+
+  auto message_w =
+    vsnprintf(NULL, 0, message_format, measured_arguments);
+
+  va_end(measured_arguments);
+
+  // We add 1 to accommodate the trailing '\0'.
+  OverwritableText message =
+    TaggedAllocate(
+      diagnostics->allocator,
+      message_w + 1,
+      DiagnosticAllocation);
+  vsnprintf(message, message_w + 1, message_format, variable_arguments);
+  va_end(variable_arguments);
+
+  // Make sure the diagnostic is properly aligned.
+  auto misalignment_w =
+    (uintptr_t) NextAddressToAllocate(diagnostics->allocator)
+    % alignof(struct Diagnostic);
+
+  if (misalignment_w != 0)
+  {
+    TaggedAllocate(
+      diagnostics->allocator,
+      alignof(struct Diagnostic) - misalignment_w,
+      DiagnosticAllocation);
+  }
+
+  struct Diagnostic *diagnostic =
+    TaggedAllocate(
+      diagnostics->allocator,
+      sizeof *diagnostic,
+      DiagnosticAllocation);
+
+  *diagnostic = (struct Diagnostic)
+  {
+    .severity = severity,
+    .line_number = line_number,
+    .column_number = column_number,
+    .message = message
+  };
+
+  // Add it to the end of the list.
+  if (diagnostics->last == NULL)
+  {
+    diagnostics->first = diagnostic;
+  }
+  else
+  {
+    diagnostics->last->next = diagnostic;
+  }
+
+  diagnostics->last = diagnostic;
+
+  switch (severity)
+  {
+    case DiagnosticWarning: diagnostics->warnings_w += 1; break;
+    case DiagnosticError: diagnostics->errors_w += 1; break;
+  }
+}
+
+
+// Have we found so many errors that we should give up?
+YesNo TooManyErrors(const struct Diagnostics *diagnostics)
+{
+  return max_errors_w != 0 && diagnostics->errors_w >= max_errors_w;
+}
+
+
+/*
+  Has this thread collected so many errors that it should give up?
+  (If it isn't collecting diagnostics, the first error exits the
+  program, so it never gets that far.)
+*/
+YesNo CollectedTooManyErrors()
+{
+  return diagnostics_collector != NULL
+         && TooManyErrors(diagnostics_collector);
+}
+
+
+/*
+  Writes every diagnostic, all at once, to the error stream (see
+  'ErrorStream').
+
+  If there were any errors, we finish with 'ExitDueToError'.
+*/
+void FinishDiagnostics(const struct Diagnostics *diagnostics)
+{
+  if (diagnostics->first == NULL)
+  {
+    return;
+  }
+
+  // We format the whole report first, then write it in one go.
+  Character *report;
+  Size report_w;
+  auto report_stream = open_memstream(&report, &report_w);
+
+  if (report_stream == NULL)
+  {
+    ExitDueToError("The compiler couldn’t open a memory stream.\n");
+  }
+
+  for (auto diagnostic = diagnostics->first;
+       diagnostic != NULL;
+       diagnostic = diagnostic->next)
+  {
+    fprintf(
+      report_stream,
+      "%s on line %zu, column %zu: %s\n",
+      severity_names[diagnostic->severity],
+      diagnostic->line_number,
+      diagnostic->column_number,
+      diagnostic->message);
+  }
+
+  if (TooManyErrors(diagnostics))
+  {
+    fprintf(
+      report_stream,
+      "That’s too many errors, so we stopped there.\n");
+  }
+
+  fclose(report_stream);
+
+  fwrite(report, 1, report_w, ErrorStream());
+  free(report);
+
+  if (diagnostics->errors_w > 0)
+  {
+    // (None of these errors are system errors.)
+    errno = 0;
+
+    ExitDueToError(
+      "The compiler found %zu error%s.\n",
+      diagnostics->errors_w,
+      (diagnostics->errors_w == 1) ? "" : "s");
+  }
+}
+
+
+/*
+  From now on, we give up after this many errors. (0 means we
+  never give up.)
+
+  Call this before starting any threads.
+*/
+void LimitErrors(Size new_max_errors_w)
+{
+  max_errors_w = new_max_errors_w;
+}
+
+
+/*
+  Which column is the character at this offset in? (The first
+  column is 1.)
+
+  Each UTF-8 character counts as one column, however many bytes
+  wide it is.
+*/
+Offset ColumnNumber(Text line, Offset character_o)
+{
+  Offset column_number = 1;
+
+  for (Offset i = 0; i < character_o; i++)
+  {
+    // We only count the first byte of each character.
+    if ((line[i] & 0b1100'0000) != 0b1000'0000)
+    {
+      column_number += 1;
+    }
+  }
+
+  return column_number;
+}
@@ -0,0 +1,75 @@
+#ifndef diagnostics_h_already_included
+#define diagnostics_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+
+
+// Unless we're told otherwise, we stop after this many errors.
+constexpr Size default_max_errors_w = 20;
+
+enum DiagnosticSeverity
+{
+  DiagnosticWarning,
+  DiagnosticError
+};
+
+// One problem we found in the T source.
+struct Diagnostic
+{
+  enum DiagnosticSeverity severity;
+
+  // (Both start at 1.)
+  Offset line_number;
+  Offset column_number;
+
+  Text message;
+
+  // The next diagnostic, in the order they were reported.
+  struct Diagnostic *next;
+};
+
+/*
+  Every problem we've found so far in the T source.
+
+  Instead of exiting at the very first problem, the tokenizer
+  reports each one here, then carries on as best it can. Once
+  we're done, we write them all at once. (See
+  'FinishDiagnostics'.)
+
+  The diagnostics (and their messages) live in the provided arena
+  allocator.
+*/
+struct Diagnostics
+{
+  struct Allocator *allocator;
+
+  struct Diagnostic *first;
+  struct Diagnostic *last;
+
+  Size warnings_w;
+  Size errors_w;
+};
+
+struct Diagnostics Diagnostics(struct Allocator *allocator);
+
+void CollectDiagnostics(struct Diagnostics *diagnostics);
+
+void ReportDiagnostic(
+  enum DiagnosticSeverity severity,
+  Offset line_number,
+  Offset column_number,
+  Text message_format,
+  ...);
+
+YesNo TooManyErrors(const struct Diagnostics *diagnostics);
+
+YesNo CollectedTooManyErrors();
+
+void FinishDiagnostics(const struct Diagnostics *diagnostics);
+
+void LimitErrors(Size max_errors_w);
+
+Offset ColumnNumber(Text line, Offset character_o);
+
+#endif
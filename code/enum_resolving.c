@@ -0,0 +1,1095 @@
+#include "enum_resolving.h"
+#include "common_data_types.h"
+#include "diagnostics.h"
+#include "memory.h"
+#include "text.h"
+#include "tokenizing.h"
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+// How many slots does a fresh symbol table have?
+constexpr Size initial_symbol_slots_w = 64;
+
+
+void StartEnumDeclaration(
+  struct EnumResolution *resolution,
+  Text name,
+  Offset line_number);
+
+void AddEnumMember(
+  struct EnumResolution *resolution,
+  Text name,
+  Size indent_level,
+  Offset line_number);
+
+void StartEnumSwitch(
+  struct EnumResolution *resolution,
+  Text subject,
+  Offset line_number);
+
+void AddEnumSwitchArm(
+  struct EnumResolution *resolution,
+  Text arm,
+  Size indent_level,
+  Offset line_number);
+
+void FinishEnumSwitch(struct EnumResolution *resolution);
+
+const struct EnumDeclaration *SwitchDeclaration(
+  const struct EnumResolution *resolution,
+  Text subject,
+  Text label,
+  Size label_w);
+
+void StartJumpTable(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch);
+
+void AddResolvedSwitchArm(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch,
+  Text label,
+  Size label_w,
+  Offset line_number,
+  Offset column_number);
+
+void AddPendingSwitchArm(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch,
+  Text label,
+  Size label_w,
+  Offset line_number,
+  Offset column_number);
+
+void CompleteEnumSwitch(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch);
+
+void ResolvePendingSwitches(struct EnumResolution *resolution);
+
+const struct EnumMember *FindEnumMember(
+  const struct EnumResolution *resolution,
+  const struct EnumDeclaration *declaration,
+  Text name,
+  Size name_w);
+
+void AddEnumSymbol(
+  struct EnumResolution *resolution,
+  const struct EnumDeclaration *declaration,
+  const struct EnumMember *member);
+
+Size EnumSymbolHash(
+  const struct EnumDeclaration *declaration,
+  Text name,
+  Size name_w);
+
+YesNo IsEnumName(Text name);
+
+YesNo IsSwitchSubject(Text subject, Text enum_name);
+
+YesNo IsOnlyToken(const struct TokenizedLine *tokenized, Text token);
+
+Memory AllocateEnumRecord(struct Allocator *allocator, Size record_w);
+
+Offset FirstTokenColumn(Size indent_level);
+
+
+// This constructor prepares an empty enum resolution pass.
+struct EnumResolution EnumResolution(
+  // Our trusty allocator.
+  struct Allocator *allocator)
+{
+  auto symbols_w = initial_symbol_slots_w * sizeof (struct EnumSymbol);
+  struct EnumSymbol *symbols = AllocateEnumRecord(allocator, symbols_w);
+  memset(symbols, 0, symbols_w);
+
+  return (struct EnumResolution)
+  {
+    .allocator = allocator,
+    .symbols = symbols,
+    .symbol_slots_w = initial_symbol_slots_w,
+    .goal = LookingForEnumsAndSwitches
+  };
+}
+
+
+/*
+  Feeds the next tokenized line to the enum resolution pass.
+  (Lines must arrive in order.)
+
+  If we find any problems, we report them (see
+  'ReportDiagnostic'), then carry on as best we can.
+*/
+void ResolveEnums(
+  struct EnumResolution *resolution,
+  const struct TokenizedLine *tokenized,
+  // Which line is this?
+  Offset line_number)
+{
+  // Empty lines and commentary don't change anything.
+  if (tokenized->tokens_w == 0)
+  {
+    return;
+  }
+
+  auto first_token = tokenized->tokens[0];
+
+  switch (resolution->goal)
+  {
+    case LookingForEnumsAndSwitches:
+    {
+      // "enum Gospel", or "enum Gospel {", at the top level.
+      auto is_enum_declaration =
+        tokenized->indent_level == 0
+        && strcmp(first_token, "enum") == 0
+        && (tokenized->tokens_w == 2
+            || (tokenized->tokens_w == 3
+                && strcmp(tokenized->tokens[2], "{") == 0))
+        && IsEnumName(tokenized->tokens[1]);
+
+      if (is_enum_declaration)
+      {
+        auto name = tokenized->tokens[1];
+
+        if (tokenized->tokens_w == 3)
+        {
+          StartEnumDeclaration(resolution, name, line_number);
+          return;
+        }
+
+        // We'll know it's an enum once we see its body.
+        resolution->expected_enum_name = CopyTextSnippet(
+          name,
+          0,
+          strlen(name),
+          resolution->allocator,
+          EnumResolutionAllocation);
+
+        resolution->expected_enum_line_number = line_number;
+        resolution->goal = ExpectingEnumBody;
+        return;
+      }
+
+      // "return switch (gospel)", and the like.
+      for (Offset i = 0; i < tokenized->tokens_w; i++)
+      {
+        if (strcmp(tokenized->tokens[i], "switch") == 0)
+        {
+          auto has_subject = (i + 1 < tokenized->tokens_w);
+          auto subject = has_subject ? tokenized->tokens[i + 1] : "";
+
+          StartEnumSwitch(resolution, subject, line_number);
+          return;
+        }
+      }
+
+      return;
+    }
+
+    case ExpectingEnumBody:
+    {
+      if (IsOnlyToken(tokenized, "{"))
+      {
+        StartEnumDeclaration(
+          resolution,
+          resolution->expected_enum_name,
+          resolution->expected_enum_line_number);
+
+        return;
+      }
+
+      // Whatever that was, it isn't an enum we understand.
+      resolution->goal = LookingForEnumsAndSwitches;
+      ResolveEnums(resolution, tokenized, line_number);
+      return;
+    }
+
+    case WithinEnumBody:
+    {
+      if (IsOnlyToken(tokenized, "}"))
+      {
+        resolution->goal = LookingForEnumsAndSwitches;
+        return;
+      }
+
+      // Every token is a member.
+      for (Offset i = 0; i < tokenized->tokens_w; i++)
+      {
+        AddEnumMember(
+          resolution,
+          tokenized->tokens[i],
+          tokenized->indent_level,
+          line_number);
+      }
+
+      return;
+    }
+
+    case ExpectingSwitchBody:
+    {
+      if (IsOnlyToken(tokenized, "{"))
+      {
+        resolution->body_indent_level = tokenized->indent_level;
+        resolution->goal = WithinSwitchBody;
+        return;
+      }
+
+      // Whatever that was, it isn't a 'switch' we understand.
+      resolution->goal = LookingForEnumsAndSwitches;
+      ResolveEnums(resolution, tokenized, line_number);
+      return;
+    }
+
+    case WithinSwitchBody:
+    {
+      auto indent_level = tokenized->indent_level;
+
+      if (indent_level == resolution->body_indent_level
+          && IsOnlyToken(tokenized, "}"))
+      {
+        FinishEnumSwitch(resolution);
+        resolution->goal = LookingForEnumsAndSwitches;
+        return;
+      }
+
+      /*
+        Each arm starts one level deeper than the braces, with its
+        label: "Matthew: ..."
+
+        (Anything deeper is part of an arm. We don't look for
+        switches within switches yet.)
+      */
+      auto first_token_w = strlen(first_token);
+
+      if (indent_level == resolution->body_indent_level + 1
+          && first_token_w > 1
+          && first_token[first_token_w - 1] == ':')
+      {
+        AddEnumSwitchArm(
+          resolution,
+          first_token,
+          indent_level,
+          line_number);
+      }
+
+      return;
+    }
+  }
+}
+
+
+/*
+  Lets the enum resolution pass know there are no more lines.
+
+  (Anything we were in the middle of never finished.)
+
+  Now that we know every enum, we resolve the switches that were
+  waiting for one. (See 'ResolvePendingSwitches'.)
+*/
+void FinishResolvingEnums(struct EnumResolution *resolution)
+{
+  switch (resolution->goal)
+  {
+    case LookingForEnumsAndSwitches:
+    case ExpectingEnumBody:
+    case ExpectingSwitchBody:
+    {
+      break;
+    }
+
+    case WithinEnumBody:
+    {
+      auto declaration = resolution->current_declaration;
+
+      ReportDiagnostic(
+        DiagnosticError,
+        declaration->line_number,
+        1,
+        "The enum '%s' never ends.",
+        declaration->name);
+
+      break;
+    }
+
+    case WithinSwitchBody:
+    {
+      ReportDiagnostic(
+        DiagnosticError,
+        resolution->current_switch->line_number,
+        1,
+        "This 'switch' never ends.");
+
+      FinishEnumSwitch(resolution);
+      break;
+    }
+  }
+
+  resolution->goal = LookingForEnumsAndSwitches;
+
+  ResolvePendingSwitches(resolution);
+}
+
+
+/*
+  Which line is the arm that handles this ordinal? (0 means no arm
+  handles it.)
+
+  This is the whole point of the jump table: one step, no matter
+  how many arms there are.
+*/
+Offset SwitchArmLineNumber(
+  const struct EnumSwitch *enum_switch,
+  Size ordinal)
+{
+  return enum_switch->arm_line_numbers[ordinal];
+}
+
+
+// Render every enum and 'switch' we resolved, for debug purposes.
+void RenderEnumResolution(
+  const struct EnumResolution *resolution,
+  FILE *output)
+{
+  for (auto declaration = resolution->first_declaration;
+       declaration != NULL;
+       declaration = declaration->next)
+  {
+    fprintf(output, "Enum %s\n", declaration->name);
+    fprintf(output, "  Line: #%zu\n", declaration->line_number);
+    fprintf(output, "  Member count: %zu\n", declaration->members_w);
+
+    for (auto member = declaration->first_member;
+         member != NULL;
+         member = member->next)
+    {
+      fprintf(output, "    %zu: %s\n", member->ordinal, member->name);
+    }
+  }
+
+  for (auto enum_switch = resolution->first_switch;
+       enum_switch != NULL;
+       enum_switch = enum_switch->next)
+  {
+    auto declaration = enum_switch->declaration;
+
+    fprintf(output, "Switch on line #%zu\n", enum_switch->line_number);
+    fprintf(output, "  Enum: %s\n", declaration->name);
+    fprintf(output, "  Jump table:\n");
+
+    for (auto member = declaration->first_member;
+         member != NULL;
+         member = member->next)
+    {
+      auto arm_line_number =
+        SwitchArmLineNumber(enum_switch, member->ordinal);
+
+      if (arm_line_number == 0)
+      {
+        fprintf(output, "    %zu: (none)\n", member->ordinal);
+      }
+      else
+      {
+        fprintf(
+          output,
+          "    %zu: line #%zu\n",
+          member->ordinal,
+          arm_line_number);
+      }
+    }
+  }
+}
+
+
+// We've found "enum <name>", and the start of its body.
+void StartEnumDeclaration(
+  struct EnumResolution *resolution,
+  Text name,
+  Offset line_number)
+{
+  struct EnumDeclaration *declaration =
+    AllocateEnumRecord(resolution->allocator, sizeof *declaration);
+
+  *declaration = (struct EnumDeclaration)
+  {
+    .name = CopyTextSnippet(
+      name,
+      0,
+      strlen(name),
+      resolution->allocator,
+      EnumResolutionAllocation),
+    .line_number = line_number,
+    .declaration_o = resolution->declarations_w
+  };
+
+  if (resolution->last_declaration == NULL)
+  {
+    resolution->first_declaration = declaration;
+  }
+  else
+  {
+    resolution->last_declaration->next = declaration;
+  }
+
+  resolution->last_declaration = declaration;
+  resolution->declarations_w += 1;
+
+  resolution->current_declaration = declaration;
+  resolution->goal = WithinEnumBody;
+}
+
+
+// We've found a member of the current enum.
+void AddEnumMember(
+  struct EnumResolution *resolution,
+  Text name,
+  Size indent_level,
+  Offset line_number)
+{
+  auto declaration = resolution->current_declaration;
+  auto name_w = strlen(name);
+
+  if (FindEnumMember(resolution, declaration, name, name_w) != NULL)
+  {
+    ReportDiagnostic(
+      DiagnosticError,
+      line_number,
+      FirstTokenColumn(indent_level),
+      "The enum '%s' already has a member named '%s'.",
+      declaration->name,
+      name);
+
+    return;
+  }
+
+  struct EnumMember *member =
+    AllocateEnumRecord(resolution->allocator, sizeof *member);
+
+  *member = (struct EnumMember)
+  {
+    .name = CopyTextSnippet(
+      name,
+      0,
+      name_w,
+      resolution->allocator,
+      EnumResolutionAllocation),
+    .ordinal = declaration->members_w
+  };
+
+  if (declaration->last_member == NULL)
+  {
+    declaration->first_member = member;
+  }
+  else
+  {
+    declaration->last_member->next = member;
+  }
+
+  declaration->last_member = member;
+  declaration->members_w += 1;
+
+  AddEnumSymbol(resolution, declaration, member);
+}
+
+
+/*
+  We've found "switch <subject>".
+
+  We don't know which enum it's over until we see its first arm,
+  so the jump table has to wait until then.
+*/
+void StartEnumSwitch(
+  struct EnumResolution *resolution,
+  Text subject,
+  Offset line_number)
+{
+  struct EnumSwitch *enum_switch =
+    AllocateEnumRecord(resolution->allocator, sizeof *enum_switch);
+
+  *enum_switch = (struct EnumSwitch)
+  {
+    .line_number = line_number,
+    .subject = CopyTextSnippet(
+      subject,
+      0,
+      strlen(subject),
+      resolution->allocator,
+      EnumResolutionAllocation)
+  };
+
+  resolution->current_switch = enum_switch;
+  resolution->goal = ExpectingSwitchBody;
+}
+
+
+/*
+  We've found an arm of the current 'switch', like "Matthew:".
+  Let's point its slot in the jump table at this line.
+
+  (If we don't know the switch's enum yet, the arm waits. See
+  'AddPendingSwitchArm'.)
+*/
+void AddEnumSwitchArm(
+  struct EnumResolution *resolution,
+  // (Including the trailing ':'.)
+  Text arm,
+  Size indent_level,
+  Offset line_number)
+{
+  auto enum_switch = resolution->current_switch;
+  auto label_w = strlen(arm) - 1;
+  auto column_number = FirstTokenColumn(indent_level);
+
+  if (label_w == strlen("default") && strncmp(arm, "default", label_w) == 0)
+  {
+    enum_switch->default_line_number = line_number;
+    return;
+  }
+
+  // The first arm tells us which enum the 'switch' is over.
+  if (enum_switch->declaration == NULL
+      && enum_switch->first_pending_arm == NULL)
+  {
+    enum_switch->declaration = SwitchDeclaration(
+      resolution,
+      enum_switch->subject,
+      arm,
+      label_w);
+
+    if (enum_switch->declaration != NULL)
+    {
+      StartJumpTable(resolution, enum_switch);
+    }
+  }
+
+  if (enum_switch->declaration == NULL)
+  {
+    AddPendingSwitchArm(
+      resolution,
+      enum_switch,
+      arm,
+      label_w,
+      line_number,
+      column_number);
+
+    return;
+  }
+
+  AddResolvedSwitchArm(
+    resolution,
+    enum_switch,
+    arm,
+    label_w,
+    line_number,
+    column_number);
+}
+
+
+/*
+  We've reached the end of the current 'switch'. If we know its
+  enum, it's complete. Otherwise, it waits for the end of the
+  source. (See 'FinishResolvingEnums'.)
+*/
+void FinishEnumSwitch(struct EnumResolution *resolution)
+{
+  auto enum_switch = resolution->current_switch;
+
+  if (enum_switch->declaration != NULL)
+  {
+    CompleteEnumSwitch(resolution, enum_switch);
+    return;
+  }
+
+  // (A 'switch' with nothing but a 'default' arm isn't for us.)
+  if (enum_switch->first_pending_arm == NULL)
+  {
+    return;
+  }
+
+  if (resolution->last_pending_switch == NULL)
+  {
+    resolution->first_pending_switch = enum_switch;
+  }
+  else
+  {
+    resolution->last_pending_switch->next = enum_switch;
+  }
+
+  resolution->last_pending_switch = enum_switch;
+}
+
+
+/*
+  Which enum is a 'switch' over, given its first arm's label?
+  Returns NULL if the label isn't a member of any enum we know of.
+
+  If several enums have a member by that name, we prefer the enum
+  named like the switch's subject. (A "(gospel)" is probably a
+  'Gospel'.) Otherwise, the earliest enum wins.
+*/
+const struct EnumDeclaration *SwitchDeclaration(
+  const struct EnumResolution *resolution,
+  Text subject,
+  // (This needn't be null-terminated.)
+  Text label,
+  Size label_w)
+{
+  const struct EnumDeclaration *found = NULL;
+
+  for (auto declaration = resolution->first_declaration;
+       declaration != NULL;
+       declaration = declaration->next)
+  {
+    if (FindEnumMember(resolution, declaration, label, label_w) == NULL)
+    {
+      continue;
+    }
+
+    if (found == NULL || IsSwitchSubject(subject, declaration->name))
+    {
+      found = declaration;
+    }
+  }
+
+  return found;
+}
+
+
+// Now that we know the switch's enum, we can build its jump table.
+void StartJumpTable(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch)
+{
+  // (0 means "no arm yet".)
+  auto table_w = enum_switch->declaration->members_w * sizeof (Offset);
+
+  enum_switch->arm_line_numbers =
+    AllocateEnumRecord(resolution->allocator, table_w);
+
+  memset(enum_switch->arm_line_numbers, 0, table_w);
+}
+
+
+// Points an arm's slot in the jump table at its line.
+void AddResolvedSwitchArm(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch,
+  // (This needn't be null-terminated.)
+  Text label,
+  Size label_w,
+  Offset line_number,
+  Offset column_number)
+{
+  auto declaration = enum_switch->declaration;
+  auto member = FindEnumMember(resolution, declaration, label, label_w);
+
+  if (member == NULL)
+  {
+    ReportDiagnostic(
+      DiagnosticError,
+      line_number,
+      column_number,
+      "The enum '%s' doesn’t have a member named '%.*s'.",
+      declaration->name,
+      (int) label_w,
+      label);
+
+    return;
+  }
+
+  if (enum_switch->arm_line_numbers[member->ordinal] != 0)
+  {
+    ReportDiagnostic(
+      DiagnosticError,
+      line_number,
+      column_number,
+      "This 'switch' already handles '%s', on line %zu.",
+      member->name,
+      enum_switch->arm_line_numbers[member->ordinal]);
+
+    return;
+  }
+
+  enum_switch->arm_line_numbers[member->ordinal] = line_number;
+}
+
+
+/*
+  Holds on to an arm until we know the switch's enum. (The line's
+  tokens won't last that long, so we copy the label.)
+*/
+void AddPendingSwitchArm(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch,
+  // (This needn't be null-terminated.)
+  Text label,
+  Size label_w,
+  Offset line_number,
+  Offset column_number)
+{
+  struct PendingSwitchArm *pending_arm =
+    AllocateEnumRecord(resolution->allocator, sizeof *pending_arm);
+
+  *pending_arm = (struct PendingSwitchArm)
+  {
+    .label = CopyTextSnippet(
+      label,
+      0,
+      label_w,
+      resolution->allocator,
+      EnumResolutionAllocation),
+    .line_number = line_number,
+    .column_number = column_number
+  };
+
+  if (enum_switch->last_pending_arm == NULL)
+  {
+    enum_switch->first_pending_arm = pending_arm;
+  }
+  else
+  {
+    enum_switch->last_pending_arm->next = pending_arm;
+  }
+
+  enum_switch->last_pending_arm = pending_arm;
+}
+
+
+/*
+  Every arm of this 'switch' is in its jump table. Any member
+  without an arm of its own goes to the 'default' arm.
+
+  Then the 'switch' joins the others, in order of line numbers.
+*/
+void CompleteEnumSwitch(
+  struct EnumResolution *resolution,
+  struct EnumSwitch *enum_switch)
+{
+  auto declaration = enum_switch->declaration;
+
+  for (auto member = declaration->first_member;
+       member != NULL;
+       member = member->next)
+  {
+    if (enum_switch->arm_line_numbers[member->ordinal] != 0)
+    {
+      continue;
+    }
+
+    if (enum_switch->default_line_number != 0)
+    {
+      enum_switch->arm_line_numbers[member->ordinal] =
+        enum_switch->default_line_number;
+    }
+    else
+    {
+      ReportDiagnostic(
+        DiagnosticWarning,
+        enum_switch->line_number,
+        1,
+        "This 'switch' doesn’t handle '%s'.",
+        member->name);
+    }
+  }
+
+  // (Switches usually complete in order, so we check the end first.)
+  enum_switch->next = NULL;
+
+  if (resolution->last_switch == NULL)
+  {
+    resolution->first_switch = enum_switch;
+    resolution->last_switch = enum_switch;
+    return;
+  }
+
+  if (resolution->last_switch->line_number < enum_switch->line_number)
+  {
+    resolution->last_switch->next = enum_switch;
+    resolution->last_switch = enum_switch;
+    return;
+  }
+
+  auto earlier_next = &resolution->first_switch;
+
+  while ((*earlier_next)->line_number < enum_switch->line_number)
+  {
+    earlier_next = &(*earlier_next)->next;
+  }
+
+  enum_switch->next = *earlier_next;
+  *earlier_next = enum_switch;
+}
+
+
+/*
+  Now that we've seen every enum, let's resolve the switches that
+  were waiting for one, just as if we'd known their enums all
+  along.
+
+  (If a switch's first arm still isn't a member of any enum, the
+  'switch' isn't over an enum, so we leave it alone.)
+*/
+void ResolvePendingSwitches(struct EnumResolution *resolution)
+{
+  auto enum_switch = resolution->first_pending_switch;
+
+  resolution->first_pending_switch = NULL;
+  resolution->last_pending_switch = NULL;
+
+  while (enum_switch != NULL)
+  {
+    // (Completing the 'switch' changes where it leads.)
+    auto next_switch = enum_switch->next;
+    auto first_arm = enum_switch->first_pending_arm;
+
+    enum_switch->declaration = SwitchDeclaration(
+      resolution,
+      enum_switch->subject,
+      first_arm->label,
+      strlen(first_arm->label));
+
+    if (enum_switch->declaration != NULL)
+    {
+      StartJumpTable(resolution, enum_switch);
+
+      for (auto arm = first_arm; arm != NULL; arm = arm->next)
+      {
+        AddResolvedSwitchArm(
+          resolution,
+          enum_switch,
+          arm->label,
+          strlen(arm->label),
+          arm->line_number,
+          arm->column_number);
+      }
+
+      CompleteEnumSwitch(resolution, enum_switch);
+    }
+
+    enum_switch = next_switch;
+  }
+}
+
+
+/*
+  Looks up a member of the given enum in the symbol table.
+  Returns NULL if there's no such member.
+*/
+const struct EnumMember *FindEnumMember(
+  const struct EnumResolution *resolution,
+  const struct EnumDeclaration *declaration,
+  // (This needn't be null-terminated.)
+  Text name,
+  Size name_w)
+{
+  auto slot_mask = resolution->symbol_slots_w - 1;
+  auto slot_o = EnumSymbolHash(declaration, name, name_w) & slot_mask;
+
+  // We check each slot in turn, until we find an empty one.
+  while (resolution->symbols[slot_o].member != NULL)
+  {
+    auto symbol = &resolution->symbols[slot_o];
+
+    if (symbol->declaration == declaration
+        && strncmp(symbol->member->name, name, name_w) == 0
+        && symbol->member->name[name_w] == '\0')
+    {
+      return symbol->member;
+    }
+
+    slot_o = (slot_o + 1) & slot_mask;
+  }
+
+  return NULL;
+}
+
+
+/*
+  Adds a member to the symbol table.
+
+  Once the table is half full, we move everything into a new
+  table twice as wide, so lookups stay quick. (The old table
+  stays behind in the arena.)
+*/
+void AddEnumSymbol(
+  struct EnumResolution *resolution,
+  const struct EnumDeclaration *declaration,
+  const struct EnumMember *member)
+{
+  if (2 * (resolution->symbols_w + 1) > resolution->symbol_slots_w)
+  {
+    auto old_symbols = resolution->symbols;
+    auto old_slots_w = resolution->symbol_slots_w;
+
+    auto slots_w = 2 * old_slots_w;
+    auto symbols_w = slots_w * sizeof (struct EnumSymbol);
+
+    resolution->symbols =
+      AllocateEnumRecord(resolution->allocator, symbols_w);
+    memset(resolution->symbols, 0, symbols_w);
+
+    resolution->symbol_slots_w = slots_w;
+    resolution->symbols_w = 0;
+
+    for (Offset slot_o = 0; slot_o < old_slots_w; slot_o++)
+    {
+      if (old_symbols[slot_o].member != NULL)
+      {
+        AddEnumSymbol(
+          resolution,
+          old_symbols[slot_o].declaration,
+          old_symbols[slot_o].member);
+      }
+    }
+  }
+
+  auto slot_mask = resolution->symbol_slots_w - 1;
+  auto name = member->name;
+  auto slot_o = EnumSymbolHash(declaration, name, strlen(name)) & slot_mask;
+
+  while (resolution->symbols[slot_o].member != NULL)
+  {
+    slot_o = (slot_o + 1) & slot_mask;
+  }
+
+  resolution->symbols[slot_o] = (struct EnumSymbol)
+  {
+    .declaration = declaration,
+    .member = member
+  };
+
+  resolution->symbols_w += 1;
+}
+
+
+/*
+  Hashes a member's name along with its enum. (That's FNV-1a,
+  mixed with the enum's 'declaration_o'.)
+*/
+Size EnumSymbolHash(
+  const struct EnumDeclaration *declaration,
+  Text name,
+  Size name_w)
+{
+  uint64_t hash = 0xcbf2'9ce4'8422'2325;
+
+  for (Offset i = 0; i < name_w; i++)
+  {
+    hash ^= (Byte) name[i];
+    hash *= 0x100'0000'01b3;
+  }
+
+  hash ^= (declaration->declaration_o + 1) * 0x9e37'79b9'7f4a'7c15;
+
+  return hash ^ (hash >> 32);
+}
+
+
+/*
+  Could this be the name of an enum? Like most names, it's made of
+  letters, digits and underscores, and it doesn't start with a
+  digit. (Any character wider than a byte counts as a letter.)
+*/
+YesNo IsEnumName(Text name)
+{
+  if (name[0] >= '0' && name[0] <= '9')
+  {
+    return false;
+  }
+
+  for (auto character = name; *character != '\0'; character++)
+  {
+    auto byte = (Byte) *character;
+
+    auto is_name_byte =
+      (byte >= 'a' && byte <= 'z')
+      || (byte >= 'A' && byte <= 'Z')
+      || (byte >= '0' && byte <= '9')
+      || byte == '_'
+      || byte >= 0x80;
+
+    if (is_name_byte == false)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/*
+  Is the 'switch' subject named after the enum? We ignore
+  parentheses and capitalization, so "(gospel)" matches "Gospel".
+*/
+YesNo IsSwitchSubject(Text subject, Text enum_name)
+{
+  auto subject_w = strlen(subject);
+
+  if (subject_w >= 2 && subject[0] == '(' && subject[subject_w - 1] == ')')
+  {
+    subject += 1;
+    subject_w -= 2;
+  }
+
+  if (subject_w != strlen(enum_name))
+  {
+    return false;
+  }
+
+  for (Offset i = 0; i < subject_w; i++)
+  {
+    auto a = subject[i];
+    auto b = enum_name[i];
+
+    if (a >= 'A' && a <= 'Z') a += 'a' - 'A';
+    if (b >= 'A' && b <= 'Z') b += 'a' - 'A';
+
+    if (a != b)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Is this line nothing but the given token?
+YesNo IsOnlyToken(const struct TokenizedLine *tokenized, Text token)
+{
+  return tokenized->tokens_w == 1 && strcmp(tokenized->tokens[0], token) == 0;
+}
+
+
+// Allocates a properly aligned record in the arena.
+Memory AllocateEnumRecord(struct Allocator *allocator, Size record_w)
+{
+  auto misalignment_w =
+    (uintptr_t) NextAddressToAllocate(allocator) % alignof(max_align_t);
+
+  if (misalignment_w != 0)
+  {
+    TaggedAllocate(
+      allocator,
+      alignof(max_align_t) - misalignment_w,
+      EnumResolutionAllocation);
+  }
+
+  return TaggedAllocate(allocator, record_w, EnumResolutionAllocation);
+}
+
+
+/*
+  Where is the first token on a line with this indent level?
+
+  (Tokens don't remember their columns, so this is the best we
+  can do. It's exact for lines indented with regular spaces.)
+*/
+Offset FirstTokenColumn(Size indent_level)
+{
+  return 1 + 2 * indent_level;
+}
@@ -0,0 +1,192 @@
+#ifndef enum_resolving_h_already_included
+#define enum_resolving_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+#include "tokenizing.h"
+#include <stdio.h>
+
+
+// One member of an enum, like 'Matthew' in 'enum Gospel'.
+struct EnumMember
+{
+  Text name;
+
+  /*
+    Members are numbered densely, in the order they're declared:
+    the first is 0, the next is 1, and so on.
+  */
+  Size ordinal;
+
+  struct EnumMember *next;
+};
+
+/*
+  Given this T code:
+
+    enum Gospel
+    {
+      Matthew
+      Mark
+      Luke
+      John
+    }
+
+  Here's the representation:
+    .name = "Gospel",
+    .members = Matthew (0), Mark (1), Luke (2), John (3),
+    .members_w = 4
+*/
+struct EnumDeclaration
+{
+  Text name;
+  Offset line_number;
+
+  // (Also numbered densely, in the order they're declared.)
+  Offset declaration_o;
+
+  struct EnumMember *first_member;
+  struct EnumMember *last_member;
+  Size members_w;
+
+  struct EnumDeclaration *next;
+};
+
+/*
+  An arm of a 'switch' we can't resolve yet, like "Monday:" before
+  we've seen 'enum Day'. (See 'FinishResolvingEnums'.)
+*/
+struct PendingSwitchArm
+{
+  // (Without the trailing ':'.)
+  Text label;
+
+  Offset line_number;
+  Offset column_number;
+
+  struct PendingSwitchArm *next;
+};
+
+/*
+  A 'switch' over an enum, lowered to a jump table.
+
+  Instead of comparing the enum's value against each arm in turn,
+  we look up the arm directly, using the value's ordinal as an
+  offset. (See 'SwitchArmLineNumber'.) No matter how many members
+  the enum has, that's a single step.
+*/
+struct EnumSwitch
+{
+  Offset line_number;
+  const struct EnumDeclaration *declaration;
+
+  /*
+    For each of the enum's ordinals, which line is the arm that
+    handles it? (That's the 'default' arm, if there isn't one of
+    its own. 0 means no arm handles it at all.)
+  */
+  Offset *arm_line_numbers;
+
+  // (0 if there isn't a 'default' arm.)
+  Offset default_line_number;
+
+  // What's it over? (Like "(gospel)".)
+  Text subject;
+
+  /*
+    If its first arm isn't a member of any enum we've seen so far,
+    the enum might be declared further down. Until we know, we
+    hold on to its arms. (If it turns out not to be over an enum
+    at all, like an integer, we leave it alone.)
+  */
+  struct PendingSwitchArm *first_pending_arm;
+  struct PendingSwitchArm *last_pending_arm;
+
+  struct EnumSwitch *next;
+};
+
+/*
+  One slot in the enum symbol table. Every member of every enum
+  has a slot, found by hashing the member's name along with its
+  enum's 'declaration_o'.
+
+  (Empty slots have a NULL member.)
+*/
+struct EnumSymbol
+{
+  const struct EnumDeclaration *declaration;
+  const struct EnumMember *member;
+};
+
+/*
+  The enum resolution pass. It works line by line, right after
+  tokenizing (see 'ResolveEnums'), so it never needs the whole
+  source at once.
+
+  Along the way, it collects every enum declaration, puts every
+  member in one flat symbol table, and lowers each 'switch' over
+  an enum to a jump table.
+
+  Everything lives in the provided arena allocator.
+*/
+struct EnumResolution
+{
+  struct Allocator *allocator;
+
+  struct EnumDeclaration *first_declaration;
+  struct EnumDeclaration *last_declaration;
+  Size declarations_w;
+
+  // (In order of their line numbers.)
+  struct EnumSwitch *first_switch;
+  struct EnumSwitch *last_switch;
+
+  // The switches waiting for enums we haven't seen yet.
+  struct EnumSwitch *first_pending_switch;
+  struct EnumSwitch *last_pending_switch;
+
+  // An open-addressed hash table. (Its width is a power of two.)
+  struct EnumSymbol *symbols;
+  Size symbols_w;
+  Size symbol_slots_w;
+
+  // What are we in the middle of?
+  enum
+  {
+    LookingForEnumsAndSwitches,
+    ExpectingEnumBody,
+    WithinEnumBody,
+    ExpectingSwitchBody,
+    WithinSwitchBody
+  } goal;
+
+  // (If we've just seen "enum Gospel", that's "Gospel".)
+  Text expected_enum_name;
+  Offset expected_enum_line_number;
+
+  // (The enum or 'switch' we're in the middle of.)
+  struct EnumDeclaration *current_declaration;
+  struct EnumSwitch *current_switch;
+
+  // How far is the current 'switch' body's opening brace indented?
+  Size body_indent_level;
+};
+
+struct EnumResolution EnumResolution(struct Allocator *allocator);
+
+void ResolveEnums(
+  struct EnumResolution *resolution,
+  const struct TokenizedLine *tokenized,
+  Offset line_number);
+
+void FinishResolvingEnums(struct EnumResolution *resolution);
+
+Offset SwitchArmLineNumber(
+  const struct EnumSwitch *enum_switch,
+  Size ordinal);
+
+void RenderEnumResolution(
+  const struct EnumResolution *resolution,
+  FILE *output);
+
+#endif
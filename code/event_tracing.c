@@ -0,0 +1,382 @@
+#include "event_tracing.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+#include "memory.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+#include <time.h>
+
+
+// How much memory can each thread's events use, at most?
+constexpr Size max_trace_buffer_w = 1024 * 1024 * 1024;
+
+/*
+  One moment in the timeline: something began or ended. (The
+  names and filenames must outlive the program's last event, so
+  they're string literals or command-line arguments.)
+*/
+struct TraceEvent
+{
+  // Nanoseconds since we started tracing.
+  Size timestamp_ns;
+
+  /*
+    Chrome's trace-event "phase": 'B' (begin) and 'E' (end) nest
+    within one thread, while 'b' and 'e' match up by 'id', so
+    they can overlap.
+  */
+  Character kind;
+
+  Text name;
+
+  // (NULL if the event isn't about one file.)
+  Text filename;
+
+  // (Only for 'b' and 'e'.)
+  Offset id;
+};
+
+/*
+  Each thread records its events into a buffer of its own, so
+  threads never wait on each other to record. The buffer lives
+  in its own reserved allocator's memory, followed by its events,
+  one after another.
+*/
+struct TraceBuffer
+{
+  struct Allocator allocator;
+
+  // (Threads are numbered in the order they record their first
+  // event, starting from 1.)
+  Size thread_number;
+  Text thread_name;
+
+  struct TraceEvent *events;
+  Size events_w;
+
+  struct TraceBuffer *next;
+};
+
+
+void WriteTraceEvents();
+
+struct TraceBuffer *CurrentTraceBuffer();
+
+void RecordTraceEvent(
+  Character kind,
+  Text name,
+  Text filename,
+  Offset id);
+
+void WriteJSONText(FILE *stream, Text text);
+
+
+// Are we tracing events at all?
+static YesNo traces_events = false;
+
+// Where do we write the events once we're done?
+static FILE *trace_file = NULL;
+
+/*
+  When did we start tracing? (We use the monotonic clock, so
+  events stay in order even if someone sets the system clock
+  while we're compiling.)
+*/
+static struct timespec start_time;
+
+// Every thread's buffer. (Protected by the mutex.)
+static mtx_t trace_buffers_mutex;
+static struct TraceBuffer *first_trace_buffer = NULL;
+static Size trace_buffers_w = 0;
+
+// (NULL until this thread records its first event.)
+static thread_local struct TraceBuffer *trace_buffer = NULL;
+
+
+/*
+  From now on, we record when each phase of compiling begins and
+  ends, on each thread, and for each file. When the program exits,
+  we write the whole timeline to the provided file, in Chrome's
+  trace-event format, ready for Perfetto or "about:tracing".
+
+  (Call this before starting any threads.)
+*/
+void StartTracingEvents(Text trace_filename)
+{
+  trace_file = fopen(trace_filename, "w");
+
+  if (trace_file == NULL)
+  {
+    ExitDueToError(
+      "The compiler couldn’t create your trace file: '%s'\n",
+      trace_filename);
+  }
+
+  mtx_init(&trace_buffers_mutex, mtx_plain);
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  traces_events = true;
+
+  if (atexit(WriteTraceEvents) != 0)
+  {
+    ExitDueToError("The compiler couldn’t arrange to write its trace.\n");
+  }
+}
+
+
+/*
+  Names the current thread in the timeline, like "Reading stage".
+  (If a thread is named more than once, the last name sticks.)
+*/
+void NameTraceThread(Text thread_name)
+{
+  if (traces_events == false)
+  {
+    return;
+  }
+
+  CurrentTraceBuffer()->thread_name = thread_name;
+}
+
+
+/*
+  The current thread starts working on something, like tokenizing
+  a batch of lines. Each 'BeginTraceEvent' needs a matching
+  'EndTraceEvent' on the same thread, and they must nest.
+
+  (The filename can be NULL.)
+*/
+void BeginTraceEvent(Text name, Text filename)
+{
+  if (traces_events == false)
+  {
+    return;
+  }
+
+  RecordTraceEvent('B', name, filename, 0);
+}
+
+
+// The current thread is done with what it began most recently.
+void EndTraceEvent(Text name, Text filename)
+{
+  if (traces_events == false)
+  {
+    return;
+  }
+
+  RecordTraceEvent('E', name, filename, 0);
+}
+
+
+/*
+  Something starts that doesn't tie up the current thread, like
+  the kernel opening a file for us. These can overlap, so each
+  has an ID, and 'EndAsyncTraceEvent' must use the same one.
+*/
+void BeginAsyncTraceEvent(Text name, Text filename, Offset id)
+{
+  if (traces_events == false)
+  {
+    return;
+  }
+
+  RecordTraceEvent('b', name, filename, id);
+}
+
+
+// Something that 'BeginAsyncTraceEvent' began is done.
+void EndAsyncTraceEvent(Text name, Text filename, Offset id)
+{
+  if (traces_events == false)
+  {
+    return;
+  }
+
+  RecordTraceEvent('e', name, filename, id);
+}
+
+
+// Writes every thread's events to the trace file. (We call this
+// on our way out.)
+void WriteTraceEvents()
+{
+  mtx_lock(&trace_buffers_mutex);
+
+  // No more events from here on.
+  traces_events = false;
+
+  fprintf(trace_file, "{\"traceEvents\":[\n");
+
+  auto first = true;
+
+  for (auto buffer = first_trace_buffer;
+       buffer != NULL;
+       buffer = buffer->next)
+  {
+    if (buffer->thread_name != NULL)
+    {
+      fprintf(
+        trace_file,
+        "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+        "\"tid\":%zu,\"args\":{\"name\":",
+        first ? "" : ",\n",
+        buffer->thread_number);
+
+      WriteJSONText(trace_file, buffer->thread_name);
+      fprintf(trace_file, "}}");
+
+      first = false;
+    }
+
+    for (Offset i = 0; i < buffer->events_w; i++)
+    {
+      auto event = &buffer->events[i];
+
+      fprintf(
+        trace_file,
+        "%s{\"name\":",
+        first ? "" : ",\n");
+
+      WriteJSONText(trace_file, event->name);
+
+      fprintf(
+        trace_file,
+        ",\"ph\":\"%c\",\"ts\":%zu.%03zu,\"pid\":1,\"tid\":%zu",
+        event->kind,
+        event->timestamp_ns / 1000,
+        event->timestamp_ns % 1000,
+        buffer->thread_number);
+
+      // (Overlapping events need a category, too.)
+      if (event->kind == 'b' || event->kind == 'e')
+      {
+        fprintf(
+          trace_file,
+          ",\"cat\":\"async\",\"id\":%zu",
+          event->id);
+      }
+
+      if (event->filename != NULL)
+      {
+        fprintf(trace_file, ",\"args\":{\"file\":");
+        WriteJSONText(trace_file, event->filename);
+        fprintf(trace_file, "}");
+      }
+
+      fprintf(trace_file, "}");
+
+      first = false;
+    }
+  }
+
+  fprintf(trace_file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  if (fclose(trace_file) != 0)
+  {
+    fprintf(stderr, "The compiler couldn’t finish writing its trace.\n");
+  }
+
+  mtx_unlock(&trace_buffers_mutex);
+}
+
+
+/*
+  Returns the current thread's buffer. If this is the thread's
+  first event, we set one up.
+*/
+struct TraceBuffer *CurrentTraceBuffer()
+{
+  if (trace_buffer != NULL)
+  {
+    return trace_buffer;
+  }
+
+  // The buffer comes first, then its events.
+  auto allocator = ReservedAllocator(max_trace_buffer_w, false);
+
+  struct TraceBuffer *buffer = TaggedAllocate(
+    &allocator,
+    sizeof *buffer,
+    TraceEventAllocation);
+
+  *buffer = (struct TraceBuffer)
+  {
+    .allocator = allocator,
+    .events = NextAddressToAllocate(&allocator)
+  };
+
+  mtx_lock(&trace_buffers_mutex);
+
+  trace_buffers_w += 1;
+  buffer->thread_number = trace_buffers_w;
+  buffer->next = first_trace_buffer;
+  first_trace_buffer = buffer;
+
+  mtx_unlock(&trace_buffers_mutex);
+
+  trace_buffer = buffer;
+  return buffer;
+}
+
+
+// Adds one event to the current thread's buffer.
+void RecordTraceEvent(
+  Character kind,
+  Text name,
+  Text filename,
+  Offset id)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  auto buffer = CurrentTraceBuffer();
+
+  // (The events are right next to each other, so this lands just
+  // after the last one.)
+  struct TraceEvent *event = TaggedAllocate(
+    &buffer->allocator,
+    sizeof *event,
+    TraceEventAllocation);
+
+  *event = (struct TraceEvent)
+  {
+    .timestamp_ns =
+      (now.tv_sec - start_time.tv_sec) * 1'000'000'000
+      + (now.tv_nsec - start_time.tv_nsec),
+    .kind = kind,
+    .name = name,
+    .filename = filename,
+    .id = id
+  };
+
+  buffer->events_w += 1;
+}
+
+
+// Writes text as a JSON string, quotes and all.
+void WriteJSONText(FILE *stream, Text text)
+{
+  fputc('"', stream);
+
+  for (; *text != '\0'; text++)
+  {
+    auto character = (Byte) *text;
+
+    if (character == '"' || character == '\\')
+    {
+      fprintf(stream, "\\%c", character);
+    }
+    else if (character < 0x20)
+    {
+      fprintf(stream, "\\u%04x", character);
+    }
+    else
+    {
+      fputc(character, stream);
+    }
+  }
+
+  fputc('"', stream);
+}
@@ -0,0 +1,19 @@
+#ifndef event_tracing_h_already_included
+#define event_tracing_h_already_included
+
+#include "common_data_types.h"
+
+
+void StartTracingEvents(Text trace_filename);
+
+void NameTraceThread(Text thread_name);
+
+void BeginTraceEvent(Text name, Text filename);
+
+void EndTraceEvent(Text name, Text filename);
+
+void BeginAsyncTraceEvent(Text name, Text filename, Offset id);
+
+void EndAsyncTraceEvent(Text name, Text filename, Offset id);
+
+#endif
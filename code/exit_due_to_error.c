@@ -6,12 +6,40 @@
 #include <string.h>
 
 
+/*
+  If this thread is recovering from errors, this points to the
+  recovery details. Otherwise, it's NULL.
+*/
+static thread_local struct ErrorRecovery *error_recovery = NULL;
+
+
+/*
+  From now on, errors on this thread jump to the provided
+  recovery's landing spot instead of exiting the program.
+
+  Pass NULL to go back to exiting the program.
+*/
+void RecoverFromErrors(struct ErrorRecovery *recovery)
+{
+  error_recovery = recovery;
+}
+
+
+// Where do this thread's error messages go?
+FILE *ErrorStream()
+{
+  return (error_recovery != NULL) ? error_recovery->error_stream : stderr;
+}
+
+
 /*
   This function exits the program and writes the provided error
   message to the standard error stream.
 
   If there's an underlying system error, this function writes
   that to the standard error stream, too.
+
+  (Unless we're recovering from errors. See 'RecoverFromErrors'.)
 */
 [[cold, noreturn]] void ExitDueToError(
   // What exactly went wrong?
@@ -20,6 +48,9 @@
   // they're bundled up here.
   ...)
 {
+  // Where should we write the error message?
+  auto error_stream = ErrorStream();
+
   // This represents those variadic '...' arguments.
   va_list variable_arguments;
 
@@ -29,7 +60,7 @@
 
   // 'vfprintf' is just like 'fprintf', but it can accept
   //  variadic arguments.
-  vfprintf(stderr, error_message_format, variable_arguments);
+  vfprintf(error_stream, error_message_format, variable_arguments);
 
   // Indicate that we're done with the variadic arguments.
   // (Secretly, I'm not entirely sure why this is necessary.)
@@ -40,11 +71,17 @@
   {
     // Let's print it.
     fprintf(
-      stderr,
+      error_stream,
       "Underlying error message: %s\n",
       strerror(errno));
   }
 
+  // If we're recovering from errors, let's jump back to safety.
+  if (error_recovery != NULL)
+  {
+    longjmp(error_recovery->landing_spot, 1);
+  }
+
   // As promised, let's exit our program.
   exit(EXIT_FAILURE);
 }
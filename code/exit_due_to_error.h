@@ -2,6 +2,29 @@
 #define exit_due_to_error_h_already_included
 
 #include "text.h"
+#include <setjmp.h>
+#include <stdio.h>
+
+
+/*
+  Long-lived modes of the compiler (like "t --serve") can't exit
+  just because one request had a problem. Instead, they can ask
+  'ExitDueToError' to report the error to a stream of their
+  choosing, then jump back to a landing spot they prepared with
+  'setjmp'.
+*/
+struct ErrorRecovery
+{
+  // Where do we jump back to?
+  jmp_buf landing_spot;
+
+  // Where do we write the error message?
+  FILE *error_stream;
+};
+
+void RecoverFromErrors(struct ErrorRecovery *recovery);
+
+FILE *ErrorStream();
 
 [[noreturn]] void ExitDueToError(Text error_message_format, ...);
 
@@ -0,0 +1,935 @@
+#include "file_loading.h"
+#include "common_data_types.h"
+#include "event_tracing.h"
+#include "exit_due_to_error.h"
+#include "memory.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#if defined(__linux__)
+  #include <fcntl.h>
+  #include <linux/io_uring.h>
+  #include <linux/stat.h>
+  #include <stdatomic.h>
+  #include <stdint.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+
+// How wide is a file's first buffer, if we don't know its size?
+constexpr Size unknown_file_buffer_w = 64 * 1024;
+
+
+YesNo ClaimFileToLoad(
+  struct FileLoader *loader,
+  YesNo may_wait,
+  Offset *file_o);
+
+void FileLoaded(struct FileLoader *loader, Offset file_o);
+
+void GrowFileBuffer(struct LoadedFile *file, Size *buffer_w);
+
+Integer LoadFilesWithThreads(Memory loader);
+
+void ReadWholeFile(struct LoadedFile *file);
+
+
+#if defined(__linux__)
+
+// Each io_uring queue has room for this many requests.
+constexpr Size io_uring_entries_w = 2 * max_files_in_flight_w;
+
+// What's an io_uring request doing? (We tuck this into the low
+// bits of its 'user_data', along with the file's offset.)
+enum FileOperation
+{
+  OpeningFile,
+  ExaminingFile,
+  ReadingFile
+};
+
+constexpr Size file_operation_bits_w = 2;
+
+// One file's progress through io_uring.
+struct FileLoad
+{
+  Integer file_descriptor;
+
+  // How many of our requests haven't completed yet?
+  Size requests_pending_w;
+
+  // The file's size is in here, with any luck.
+  struct statx status;
+
+  Size buffer_w;
+
+  // Have we started reading? (Not if anything went wrong before
+  // then, even if the file did open.)
+  YesNo reading;
+};
+
+/*
+  Our io_uring "instance": a submission queue, where we add
+  requests, and a completion queue, where the kernel adds the
+  results. We share both with the kernel, so no system call is
+  needed to add a request, only to tell the kernel about it.
+*/
+struct IOUring
+{
+  Integer file_descriptor;
+
+  Memory queues;
+  Size queues_w;
+
+  _Atomic unsigned *submission_tail;
+  unsigned *submission_ring_mask;
+  unsigned *submission_array;
+  struct io_uring_sqe *submissions;
+  Size submissions_w;
+
+  // How many requests haven't we told the kernel about yet?
+  Size unsubmitted_w;
+
+  _Atomic unsigned *completion_head;
+  _Atomic unsigned *completion_tail;
+  unsigned *completion_ring_mask;
+  struct io_uring_cqe *completions;
+
+  // For each file.
+  struct FileLoad *loads;
+  Size loads_in_progress_w;
+};
+
+struct IOUring *IOUring(
+  struct FileLoader *loader,
+  struct Allocator *allocator);
+
+YesNo SupportsEveryOperation(
+  Integer io_uring_descriptor,
+  struct Allocator *allocator);
+
+Integer LoadFilesWithIOUring(Memory loader);
+
+void StartLoadingFile(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  Offset file_o);
+
+void RequestRead(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  Offset file_o);
+
+void Request(
+  struct IOUring *ring,
+  struct io_uring_sqe request,
+  enum FileOperation operation,
+  Offset file_o);
+
+void SubmitAndWait(struct IOUring *ring);
+
+void HandleCompletion(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  const struct io_uring_cqe *completion);
+
+void FinishLoadingFile(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  Offset file_o);
+
+#endif
+
+
+/*
+  Starts loading the named files in the background. Use
+  'NextLoadedFile' to take each one as it's loaded.
+
+  The loader's bookkeeping comes from the provided allocator,
+  which must outlive the loader.
+*/
+void StartLoadingFiles(
+  struct FileLoader *loader,
+  Text filenames[],
+  Size filenames_w,
+  // Our trusty allocator.
+  struct Allocator *allocator)
+{
+  *loader = (struct FileLoader)
+  {
+    .files = TaggedAllocate(
+      allocator,
+      filenames_w * sizeof (struct LoadedFile),
+      FileLoadingAllocation),
+    .files_w = filenames_w,
+    .loaded_file_os = TaggedAllocate(
+      allocator,
+      filenames_w * sizeof (Offset),
+      FileLoadingAllocation)
+  };
+
+  for (Offset i = 0; i < filenames_w; i++)
+  {
+    loader->files[i] = (struct LoadedFile) { .filename = filenames[i] };
+  }
+
+  if (mtx_init(&loader->mutex, mtx_plain) != thrd_success
+      || cnd_init(&loader->file_loaded) != thrd_success
+      || cnd_init(&loader->file_taken) != thrd_success)
+  {
+    ExitDueToError("The compiler couldn’t prepare to load files.\n");
+  }
+
+#if defined(__linux__)
+  loader->io_uring = IOUring(loader, allocator);
+
+  if (loader->io_uring != NULL)
+  {
+    if (thrd_create(&loader->threads[0], LoadFilesWithIOUring, loader)
+        != thrd_success)
+    {
+      ExitDueToError("The compiler couldn’t start a loading thread.\n");
+    }
+
+    loader->threads_w = 1;
+    return;
+  }
+#endif
+
+  // No io_uring? No problem. We'll just use a few threads.
+  loader->threads_w = max_loading_threads_w;
+
+  if (loader->threads_w > filenames_w)
+  {
+    loader->threads_w = filenames_w;
+  }
+
+  for (Offset i = 0; i < loader->threads_w; i++)
+  {
+    if (thrd_create(&loader->threads[i], LoadFilesWithThreads, loader)
+        != thrd_success)
+    {
+      ExitDueToError("The compiler couldn’t start a loading thread.\n");
+    }
+  }
+}
+
+
+/*
+  Takes the next loaded file, waiting for one if need be. Returns
+  NULL once every file has been taken.
+
+  Many threads can take files at once.
+*/
+struct LoadedFile *NextLoadedFile(struct FileLoader *loader)
+{
+  mtx_lock(&loader->mutex);
+
+  while (loader->taken_w == loader->loaded_w
+         && loader->taken_w < loader->files_w)
+  {
+    cnd_wait(&loader->file_loaded, &loader->mutex);
+  }
+
+  struct LoadedFile *file = NULL;
+
+  if (loader->taken_w < loader->files_w)
+  {
+    file = &loader->files[loader->loaded_file_os[loader->taken_w]];
+    loader->taken_w += 1;
+
+    // That makes room for another file.
+    cnd_signal(&loader->file_taken);
+
+    // If that was the last one, nobody else needs to wait.
+    if (loader->taken_w == loader->files_w)
+    {
+      cnd_broadcast(&loader->file_loaded);
+    }
+  }
+
+  mtx_unlock(&loader->mutex);
+
+  return file;
+}
+
+
+// Frees a loaded file's text, once we're done with it.
+void ReleaseLoadedFile(struct LoadedFile *file)
+{
+  free(file->text);
+  file->text = NULL;
+}
+
+
+// Waits for the loading threads to finish, then cleans up.
+void FinishLoadingFiles(struct FileLoader *loader)
+{
+  for (Offset i = 0; i < loader->threads_w; i++)
+  {
+    thrd_join(loader->threads[i], NULL);
+  }
+
+#if defined(__linux__)
+  if (loader->io_uring != NULL)
+  {
+    auto ring = loader->io_uring;
+
+    munmap(ring->submissions, ring->submissions_w);
+    munmap(ring->queues, ring->queues_w);
+    close(ring->file_descriptor);
+  }
+#endif
+
+  cnd_destroy(&loader->file_taken);
+  cnd_destroy(&loader->file_loaded);
+  mtx_destroy(&loader->mutex);
+}
+
+
+/*
+  Claims the next file to load, provided there's room for it.
+  Returns false if there are no files left, or (if we may not
+  wait) there's no room right now.
+
+  There's room as long as the files being loaded, plus the files
+  loaded but not yet taken, are few enough. That way, loading
+  can't get too far ahead of whoever's taking the files.
+*/
+YesNo ClaimFileToLoad(
+  struct FileLoader *loader,
+  YesNo may_wait,
+  Offset *file_o)
+{
+  YesNo claimed = false;
+
+  mtx_lock(&loader->mutex);
+
+  while (loader->next_file_o < loader->files_w)
+  {
+    auto waiting_w = loader->loaded_w - loader->taken_w;
+
+    if (loader->loading_w + waiting_w < max_files_in_flight_w)
+    {
+      *file_o = loader->next_file_o;
+      loader->next_file_o += 1;
+      loader->loading_w += 1;
+
+      claimed = true;
+      break;
+    }
+
+    if (may_wait == false)
+    {
+      break;
+    }
+
+    cnd_wait(&loader->file_taken, &loader->mutex);
+  }
+
+  mtx_unlock(&loader->mutex);
+
+  return claimed;
+}
+
+
+// Hands a file over to whoever's waiting for one.
+void FileLoaded(struct FileLoader *loader, Offset file_o)
+{
+  mtx_lock(&loader->mutex);
+
+  loader->loaded_file_os[loader->loaded_w] = file_o;
+  loader->loaded_w += 1;
+  loader->loading_w -= 1;
+
+  cnd_signal(&loader->file_loaded);
+
+  mtx_unlock(&loader->mutex);
+}
+
+
+// Makes a file's buffer twice as wide (or gives it its first one).
+void GrowFileBuffer(struct LoadedFile *file, Size *buffer_w)
+{
+  *buffer_w = (*buffer_w == 0) ? unknown_file_buffer_w : 2 * *buffer_w;
+  file->text = realloc(file->text, *buffer_w);
+
+  if (file->text == NULL)
+  {
+    ExitDueToError(
+      "The compiler ran out of memory loading '%s'.\n",
+      file->filename);
+  }
+}
+
+
+// A loading thread's job, when there's no io_uring: keep loading
+// files until there are none left.
+Integer LoadFilesWithThreads(Memory loader_memory)
+{
+  struct FileLoader *loader = loader_memory;
+  Offset file_o;
+
+  NameTraceThread("Loader");
+
+  while (ClaimFileToLoad(loader, true, &file_o))
+  {
+    ReadWholeFile(&loader->files[file_o]);
+    FileLoaded(loader, file_o);
+  }
+
+  return 0;
+}
+
+
+// Reads a whole file into memory, the old-fashioned way.
+void ReadWholeFile(struct LoadedFile *file)
+{
+  BeginTraceEvent("Open", file->filename);
+  auto stream = fopen(file->filename, "r");
+  EndTraceEvent("Open", file->filename);
+
+  if (stream == NULL)
+  {
+    file->error_number = errno;
+    return;
+  }
+
+  file->opened = true;
+
+  BeginTraceEvent("Read", file->filename);
+
+  Size buffer_w = 0;
+
+  while (true)
+  {
+    if (file->text_w == buffer_w)
+    {
+      GrowFileBuffer(file, &buffer_w);
+    }
+
+    auto space_w = buffer_w - file->text_w;
+    auto read_w = fread(file->text + file->text_w, 1, space_w, stream);
+
+    file->text_w += read_w;
+
+    // If we read less than we asked for, we've reached the end.
+    if (read_w < space_w)
+    {
+      break;
+    }
+  }
+
+  if (ferror(stream))
+  {
+    file->error_number = (errno != 0) ? errno : EIO;
+  }
+
+  fclose(stream);
+
+  EndTraceEvent("Read", file->filename);
+}
+
+
+#if defined(__linux__)
+
+/*
+  Sets up io_uring, provided the kernel supports everything we
+  need. Otherwise (for example, when io_uring has been disabled),
+  returns NULL.
+*/
+struct IOUring *IOUring(
+  struct FileLoader *loader,
+  // Our trusty allocator.
+  struct Allocator *allocator)
+{
+  struct io_uring_params parameters = {};
+
+  Integer file_descriptor =
+    syscall(__NR_io_uring_setup, io_uring_entries_w, &parameters);
+
+  if (file_descriptor < 0)
+  {
+    return NULL;
+  }
+
+  // Older kernels need separate mappings for each queue. We just
+  // use threads there.
+  if ((parameters.features & IORING_FEAT_SINGLE_MMAP) == 0
+      || SupportsEveryOperation(file_descriptor, allocator) == false)
+  {
+    close(file_descriptor);
+    return NULL;
+  }
+
+  // Both queues share one mapping.
+  Size submission_queue_w =
+    parameters.sq_off.array + parameters.sq_entries * sizeof (unsigned);
+
+  Size completion_queue_w =
+    parameters.cq_off.cqes
+    + parameters.cq_entries * sizeof (struct io_uring_cqe);
+
+  Size queues_w = (submission_queue_w > completion_queue_w)
+    ? submission_queue_w
+    : completion_queue_w;
+
+  Byte *queues = mmap(
+    NULL,
+    queues_w,
+    PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE,
+    file_descriptor,
+    IORING_OFF_SQ_RING);
+
+  // The requests themselves live in a separate array.
+  Size submissions_w =
+    parameters.sq_entries * sizeof (struct io_uring_sqe);
+
+  struct io_uring_sqe *submissions = mmap(
+    NULL,
+    submissions_w,
+    PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE,
+    file_descriptor,
+    IORING_OFF_SQES);
+
+  if (queues == MAP_FAILED || submissions == MAP_FAILED)
+  {
+    ExitDueToError("The compiler couldn’t map io_uring’s queues.\n");
+  }
+
+  struct IOUring *ring = TaggedAllocate(
+    allocator,
+    sizeof *ring,
+    FileLoadingAllocation);
+
+  *ring = (struct IOUring)
+  {
+    .file_descriptor = file_descriptor,
+    .queues = queues,
+    .queues_w = queues_w,
+    .submission_tail = (Memory) (queues + parameters.sq_off.tail),
+    .submission_ring_mask = (Memory) (queues + parameters.sq_off.ring_mask),
+    .submission_array = (Memory) (queues + parameters.sq_off.array),
+    .submissions = submissions,
+    .submissions_w = submissions_w,
+    .completion_head = (Memory) (queues + parameters.cq_off.head),
+    .completion_tail = (Memory) (queues + parameters.cq_off.tail),
+    .completion_ring_mask = (Memory) (queues + parameters.cq_off.ring_mask),
+    .completions = (Memory) (queues + parameters.cq_off.cqes),
+    .loads = TaggedAllocate(
+      allocator,
+      loader->files_w * sizeof (struct FileLoad),
+      FileLoadingAllocation)
+  };
+
+  return ring;
+}
+
+
+// Can io_uring open, examine and read files? (Kernels before 5.6
+// can't.)
+YesNo SupportsEveryOperation(
+  Integer io_uring_descriptor,
+  // Our trusty allocator.
+  struct Allocator *allocator)
+{
+  constexpr Size max_operations_w = 256;
+
+  Size probe_w =
+    sizeof (struct io_uring_probe)
+    + max_operations_w * sizeof (struct io_uring_probe_op);
+
+  // The kernel insists on a zeroed probe.
+  struct io_uring_probe *probe = TaggedAllocate(
+    allocator,
+    probe_w,
+    FileLoadingAllocation);
+  memset(probe, 0, probe_w);
+
+  if (syscall(
+        __NR_io_uring_register,
+        io_uring_descriptor,
+        IORING_REGISTER_PROBE,
+        probe,
+        max_operations_w) < 0)
+  {
+    return false;
+  }
+
+  constexpr Byte operations[] =
+  {
+    IORING_OP_OPENAT,
+    IORING_OP_STATX,
+    IORING_OP_READ
+  };
+
+  for (Offset i = 0; i < sizeof operations; i++)
+  {
+    if (operations[i] > probe->last_op
+        || (probe->ops[operations[i]].flags & IO_URING_OP_SUPPORTED) == 0)
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+/*
+  The io_uring loading thread's job: keep plenty of files loading
+  at once, until every file has been loaded.
+
+  Each file takes a few steps. First, we ask to open it and to
+  examine it (to learn its size) at the same time. Once both are
+  done, we ask to read it, as many times as it takes.
+*/
+Integer LoadFilesWithIOUring(Memory loader_memory)
+{
+  struct FileLoader *loader = loader_memory;
+  auto ring = loader->io_uring;
+
+  NameTraceThread("Loader (io_uring)");
+
+  while (true)
+  {
+    /*
+      Start loading every file we have room for. If nothing's
+      loading right now, we've got nothing better to do than wait
+      for room.
+    */
+    Offset file_o;
+
+    while (ClaimFileToLoad(
+             loader,
+             ring->loads_in_progress_w == 0,
+             &file_o))
+    {
+      StartLoadingFile(loader, ring, file_o);
+    }
+
+    if (ring->loads_in_progress_w == 0)
+    {
+      // We're all done!
+      break;
+    }
+
+    SubmitAndWait(ring);
+
+    // Take care of whatever's completed.
+    auto head = atomic_load_explicit(
+      ring->completion_head,
+      memory_order_relaxed);
+
+    auto tail = atomic_load_explicit(
+      ring->completion_tail,
+      memory_order_acquire);
+
+    while (head != tail)
+    {
+      auto completion =
+        ring->completions[head & *ring->completion_ring_mask];
+
+      // Now the kernel can reuse the completion's spot.
+      head += 1;
+      atomic_store_explicit(
+        ring->completion_head,
+        head,
+        memory_order_release);
+
+      HandleCompletion(loader, ring, &completion);
+    }
+  }
+
+  return 0;
+}
+
+
+// Asks to open a file and examine it, both at once.
+void StartLoadingFile(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  Offset file_o)
+{
+  auto filename = loader->files[file_o].filename;
+  auto load = &ring->loads[file_o];
+
+  *load = (struct FileLoad)
+  {
+    .file_descriptor = -1,
+    .requests_pending_w = 2
+  };
+
+  Request(
+    ring,
+    (struct io_uring_sqe)
+    {
+      .opcode = IORING_OP_OPENAT,
+      .fd = AT_FDCWD,
+      .addr = (uintptr_t) filename,
+      .open_flags = O_RDONLY | O_CLOEXEC
+    },
+    OpeningFile,
+    file_o);
+
+  Request(
+    ring,
+    (struct io_uring_sqe)
+    {
+      .opcode = IORING_OP_STATX,
+      .fd = AT_FDCWD,
+      .addr = (uintptr_t) filename,
+      .len = STATX_SIZE,
+      // (Where the kernel writes the results.)
+      .off = (uintptr_t) &load->status
+    },
+    ExaminingFile,
+    file_o);
+
+  ring->loads_in_progress_w += 1;
+
+  // (Many files load at once, so their events overlap.)
+  BeginAsyncTraceEvent("Open", filename, file_o);
+}
+
+
+// Asks to read as much of a file as its buffer has room for.
+void RequestRead(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  Offset file_o)
+{
+  auto file = &loader->files[file_o];
+  auto load = &ring->loads[file_o];
+
+  if (file->text_w == load->buffer_w)
+  {
+    GrowFileBuffer(file, &load->buffer_w);
+  }
+
+  // The kernel only accepts 32-bit widths here.
+  auto space_w = load->buffer_w - file->text_w;
+
+  if (space_w > UINT32_MAX)
+  {
+    space_w = UINT32_MAX;
+  }
+
+  Request(
+    ring,
+    (struct io_uring_sqe)
+    {
+      .opcode = IORING_OP_READ,
+      .fd = load->file_descriptor,
+      .addr = (uintptr_t) (file->text + file->text_w),
+      .len = space_w,
+      .off = file->text_w
+    },
+    ReadingFile,
+    file_o);
+
+  load->requests_pending_w += 1;
+}
+
+
+// Adds a request to the submission queue. (We tell the kernel
+// about it later.)
+void Request(
+  struct IOUring *ring,
+  struct io_uring_sqe request,
+  enum FileOperation operation,
+  Offset file_o)
+{
+  request.user_data = (file_o << file_operation_bits_w) | operation;
+
+  // We're the only ones who change the tail.
+  auto tail = atomic_load_explicit(
+    ring->submission_tail,
+    memory_order_relaxed);
+
+  auto request_o = tail & *ring->submission_ring_mask;
+
+  ring->submissions[request_o] = request;
+  ring->submission_array[request_o] = request_o;
+
+  // The kernel mustn't see the new tail before the request.
+  atomic_store_explicit(
+    ring->submission_tail,
+    tail + 1,
+    memory_order_release);
+
+  ring->unsubmitted_w += 1;
+}
+
+
+/*
+  Tells the kernel about our new requests, then waits until at
+  least one request has completed.
+*/
+void SubmitAndWait(struct IOUring *ring)
+{
+  while (true)
+  {
+    Integer submitted_w = syscall(
+      __NR_io_uring_enter,
+      ring->file_descriptor,
+      ring->unsubmitted_w,
+      1,
+      IORING_ENTER_GETEVENTS,
+      NULL,
+      0);
+
+    if (submitted_w >= 0)
+    {
+      ring->unsubmitted_w -= submitted_w;
+      return;
+    }
+
+    // If there are completions to take care of first, that's fine.
+    if (errno == EBUSY || errno == EAGAIN)
+    {
+      return;
+    }
+
+    if (errno != EINTR)
+    {
+      ExitDueToError("The compiler couldn’t submit io_uring requests.\n");
+    }
+  }
+}
+
+
+// One of our requests has completed. What's next for its file?
+void HandleCompletion(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  const struct io_uring_cqe *completion)
+{
+  Offset file_o = completion->user_data >> file_operation_bits_w;
+  enum FileOperation operation =
+    completion->user_data & ((1 << file_operation_bits_w) - 1);
+
+  auto file = &loader->files[file_o];
+  auto load = &ring->loads[file_o];
+
+  // Negative results are (negated) error numbers.
+  auto result = completion->res;
+  load->requests_pending_w -= 1;
+
+  switch (operation)
+  {
+    case OpeningFile:
+      if (result < 0)
+      {
+        file->error_number = -result;
+      }
+      else
+      {
+        load->file_descriptor = result;
+        file->opened = true;
+      }
+      break;
+
+    case ExaminingFile:
+      // If this didn't work, we'll just read until the end.
+      if (result < 0)
+      {
+        load->status.stx_size = 0;
+      }
+      break;
+
+    case ReadingFile:
+      if (result < 0)
+      {
+        file->error_number = -result;
+        FinishLoadingFile(loader, ring, file_o);
+        return;
+      }
+
+      file->text_w += result;
+
+      /*
+        We're done once we've read as much as the file holds, if
+        we know how much that is. Otherwise, we're done when
+        there's nothing left to read.
+      */
+      auto known_w = load->status.stx_size;
+
+      if (result == 0 || (known_w > 0 && file->text_w >= known_w))
+      {
+        FinishLoadingFile(loader, ring, file_o);
+        return;
+      }
+
+      RequestRead(loader, ring, file_o);
+      return;
+  }
+
+  // Wait until we've both opened and examined the file.
+  if (load->requests_pending_w > 0)
+  {
+    return;
+  }
+
+  EndAsyncTraceEvent("Open", file->filename, file_o);
+
+  if (file->error_number != 0)
+  {
+    FinishLoadingFile(loader, ring, file_o);
+    return;
+  }
+
+  BeginAsyncTraceEvent("Read", file->filename, file_o);
+  load->reading = true;
+
+  // If we know the file's size, we read it all at once.
+  if (load->status.stx_size > 0)
+  {
+    load->buffer_w = load->status.stx_size;
+    file->text = malloc(load->buffer_w);
+
+    if (file->text == NULL)
+    {
+      ExitDueToError(
+        "The compiler ran out of memory loading '%s'.\n",
+        file->filename);
+    }
+  }
+
+  RequestRead(loader, ring, file_o);
+}
+
+
+// Closes a loaded file, and hands it over.
+void FinishLoadingFile(
+  struct FileLoader *loader,
+  struct IOUring *ring,
+  Offset file_o)
+{
+  auto load = &ring->loads[file_o];
+
+  if (load->file_descriptor >= 0)
+  {
+    close(load->file_descriptor);
+  }
+
+  if (load->reading)
+  {
+    EndAsyncTraceEvent(
+      "Read",
+      loader->files[file_o].filename,
+      file_o);
+  }
+
+  ring->loads_in_progress_w -= 1;
+  FileLoaded(loader, file_o);
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef file_loading_h_already_included
+#define file_loading_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+#include <threads.h>
+
+
+struct IOUring;
+
+// How many files can be loading (or loaded, but not yet taken)
+// at once?
+constexpr Size max_files_in_flight_w = 64;
+
+// How many threads read files when io_uring isn't available?
+constexpr Size max_loading_threads_w = 4;
+
+// A file, loaded into memory (or not).
+struct LoadedFile
+{
+  Text filename;
+
+  // The file's whole contents, from 'malloc'. (Not
+  // null-terminated.)
+  Character *text;
+  Size text_w;
+
+  /*
+    If loading failed, this is the system's error number, and
+    'opened' says whether we got as far as opening the file.
+    Otherwise, it's 0.
+  */
+  Integer error_number;
+  YesNo opened;
+};
+
+/*
+  Loads many files in the background, handing each one over as
+  soon as it's loaded. (Not necessarily in order!)
+
+  On Linux, we ask io_uring to open, examine and read lots of
+  files at once, so the disk always has plenty to do. Elsewhere
+  (or if io_uring is off limits), a few threads read the files
+  the old-fashioned way instead.
+*/
+struct FileLoader
+{
+  struct LoadedFile *files;
+  Size files_w;
+
+  // These are all protected by the mutex.
+  mtx_t mutex;
+  Offset next_file_o;
+  Size loading_w;
+  // The offsets of loaded files, in the order they were loaded.
+  Offset *loaded_file_os;
+  Size loaded_w;
+  Size taken_w;
+
+  // "A file was loaded", and "a loaded file was taken".
+  cnd_t file_loaded;
+  cnd_t file_taken;
+
+  thrd_t threads[max_loading_threads_w];
+  Size threads_w;
+
+  // (NULL unless we're using io_uring.)
+  struct IOUring *io_uring;
+};
+
+void StartLoadingFiles(
+  struct FileLoader *loader,
+  Text filenames[],
+  Size filenames_w,
+  struct Allocator *allocator);
+
+struct LoadedFile *NextLoadedFile(struct FileLoader *loader);
+
+void ReleaseLoadedFile(struct LoadedFile *file);
+
+void FinishLoadingFiles(struct FileLoader *loader);
+
+#endif
@@ -0,0 +1,686 @@
+#include "kernels.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+#include "memory.h"
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+
+/*
+  On x86-64 processors, we build SIMD versions of each kernel,
+  too. Each function's 'target' attribute lets it use newer
+  instructions than the rest of the program.
+*/
+#if defined(__x86_64__) && defined(__GNUC__)
+  #include <immintrin.h>
+  #define x86_kernels_included
+#endif
+
+
+void ClassifyBytesScalar(Text bytes, Size bytes_w, Byte classes[]);
+
+Size ValidUTF8WidthScalar(Text text, Size text_w);
+
+void IndexNewlinesScalar(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator);
+
+Size ValidUTF8CharacterWidth(const Byte *bytes, Size bytes_w);
+
+void ChooseBestKernels();
+
+#if defined(x86_kernels_included)
+
+void ClassifyBytesSSE2(Text bytes, Size bytes_w, Byte classes[]);
+Size ValidUTF8WidthSSE2(Text text, Size text_w);
+void IndexNewlinesSSE2(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator);
+
+void ClassifyBytesAVX2(Text bytes, Size bytes_w, Byte classes[]);
+Size ValidUTF8WidthAVX2(Text text, Size text_w);
+void IndexNewlinesAVX2(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator);
+
+void ClassifyBytesAVX512(Text bytes, Size bytes_w, Byte classes[]);
+Size ValidUTF8WidthAVX512(Text text, Size text_w);
+void IndexNewlinesAVX512(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator);
+
+#endif
+
+
+// Every set of kernels we know about, from oldest to newest.
+static const struct KernelSet kernel_sets[] =
+{
+  {
+    .name = "scalar",
+    .ClassifyBytes = ClassifyBytesScalar,
+    .ValidUTF8Width = ValidUTF8WidthScalar,
+    .IndexNewlines = IndexNewlinesScalar
+  },
+#if defined(x86_kernels_included)
+  {
+    .name = "sse2",
+    .ClassifyBytes = ClassifyBytesSSE2,
+    .ValidUTF8Width = ValidUTF8WidthSSE2,
+    .IndexNewlines = IndexNewlinesSSE2
+  },
+  {
+    .name = "avx2",
+    .ClassifyBytes = ClassifyBytesAVX2,
+    .ValidUTF8Width = ValidUTF8WidthAVX2,
+    .IndexNewlines = IndexNewlinesAVX2
+  },
+  {
+    .name = "avx512",
+    .ClassifyBytes = ClassifyBytesAVX512,
+    .ValidUTF8Width = ValidUTF8WidthAVX512,
+    .IndexNewlines = IndexNewlinesAVX512
+  },
+#endif
+};
+
+constexpr Size kernel_sets_w = sizeof kernel_sets / sizeof kernel_sets[0];
+
+static const struct KernelSet *active_kernels = NULL;
+static once_flag choosing_kernels = ONCE_FLAG_INIT;
+
+
+/*
+  Returns the kernels we're using. Unless someone asked for
+  particular kernels (see 'UseKernels'), the first call picks the
+  best ones this processor can run.
+*/
+const struct KernelSet *ActiveKernels()
+{
+  call_once(&choosing_kernels, ChooseBestKernels);
+
+  return active_kernels;
+}
+
+
+/*
+  From now on, we use the named kernels, instead of the best ones.
+  (This is handy for comparing them.)
+
+  Call this before starting any threads.
+*/
+void UseKernels(Text name)
+{
+  for (Offset i = 0; i < kernel_sets_w; i++)
+  {
+    if (strcmp(kernel_sets[i].name, name) != 0)
+    {
+      continue;
+    }
+
+#if defined(x86_kernels_included)
+    __builtin_cpu_init();
+
+    if ((strcmp(name, "avx2") == 0 && !__builtin_cpu_supports("avx2"))
+        || (strcmp(name, "avx512") == 0
+            && !__builtin_cpu_supports("avx512bw")))
+    {
+      ExitDueToError(
+        "This processor can’t run the '%s' kernels.\n",
+        name);
+    }
+#endif
+
+    active_kernels = &kernel_sets[i];
+    return;
+  }
+
+  ExitDueToError(
+    "There aren’t any kernels named '%s'.\n"
+    "Try 'scalar', 'sse2', 'avx2' or 'avx512'.\n",
+    name);
+}
+
+
+// Picks the best kernels this processor can run, unless someone
+// already picked.
+void ChooseBestKernels()
+{
+  if (active_kernels != NULL)
+  {
+    return;
+  }
+
+  active_kernels = &kernel_sets[0];
+
+#if defined(x86_kernels_included)
+  __builtin_cpu_init();
+
+  // (Every x86-64 processor supports SSE2.)
+  active_kernels = &kernel_sets[1];
+
+  if (__builtin_cpu_supports("avx2"))
+  {
+    active_kernels = &kernel_sets[2];
+  }
+
+  if (__builtin_cpu_supports("avx512bw"))
+  {
+    active_kernels = &kernel_sets[3];
+  }
+#endif
+}
+
+
+// Classifies each byte, one at a time.
+void ClassifyBytesScalar(Text bytes, Size bytes_w, Byte classes[])
+{
+  for (Offset i = 0; i < bytes_w; i++)
+  {
+    Byte byte = bytes[i];
+
+    classes[i] =
+        (byte == ' ') ? SpaceByte
+      : (byte == '\t') ? TabByte
+      : (byte & 0b1000'0000) ? MultibyteByte
+      : CodeByte;
+  }
+}
+
+
+// Validates UTF-8 text, one character at a time.
+Size ValidUTF8WidthScalar(Text text, Size text_w)
+{
+  const Byte *bytes = (const Byte*) text;
+  Offset text_o = 0;
+
+  while (text_o < text_w)
+  {
+    auto character_w = ValidUTF8CharacterWidth(
+      bytes + text_o,
+      text_w - text_o);
+
+    if (character_w == 0)
+    {
+      return text_o;
+    }
+
+    text_o += character_w;
+  }
+
+  return text_w;
+}
+
+
+// Finds newline characters with 'memchr', one at a time.
+void IndexNewlinesScalar(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator)
+{
+  auto source_o = from_o;
+
+  while (source_o < source_w)
+  {
+    Text newline = memchr(source + source_o, '\n', source_w - source_o);
+
+    if (newline == NULL)
+    {
+      break;
+    }
+
+    Offset *line_start_o = TaggedAllocate(
+      allocator,
+      sizeof (Offset),
+      LineIndexAllocation);
+    *line_start_o = newline - source + 1;
+
+    source_o = *line_start_o;
+  }
+}
+
+
+/*
+  How many bytes wide is the UTF-8 character at the start of
+  these bytes? If it isn't a valid UTF-8 character, returns 0.
+
+  (See 'UTF8Codepoint' for how UTF-8 works.)
+
+  Beyond having the right bits in the right places, a valid
+  character can't be "overlong" (wider than it needs to be), and
+  its codepoint can't be a UTF-16 "surrogate" or beyond the very
+  last Unicode codepoint.
+*/
+Size ValidUTF8CharacterWidth(const Byte *bytes, Size bytes_w)
+{
+  auto first_byte = bytes[0];
+
+  if ((first_byte & 0b1000'0000) == 0)
+  {
+    return 1;
+  }
+
+  Size character_w;
+  UTFCodepoint codepoint;
+  UTFCodepoint smallest_codepoint;
+
+  if ((first_byte & 0b1110'0000) == 0b1100'0000)
+  {
+    character_w = 2;
+    codepoint = first_byte & 0b0001'1111;
+    smallest_codepoint = 0x80;
+  }
+  else if ((first_byte & 0b1111'0000) == 0b1110'0000)
+  {
+    character_w = 3;
+    codepoint = first_byte & 0b0000'1111;
+    smallest_codepoint = 0x800;
+  }
+  else if ((first_byte & 0b1111'1000) == 0b1111'0000)
+  {
+    character_w = 4;
+    codepoint = first_byte & 0b0000'0111;
+    smallest_codepoint = 0x1'0000;
+  }
+  else
+  {
+    return 0;
+  }
+
+  if (character_w > bytes_w)
+  {
+    return 0;
+  }
+
+  for (Offset i = 1; i < character_w; i++)
+  {
+    if ((bytes[i] & 0b1100'0000) != 0b1000'0000)
+    {
+      return 0;
+    }
+
+    codepoint = (codepoint << 6) | (bytes[i] & 0b0011'1111);
+  }
+
+  if (codepoint < smallest_codepoint
+      || (codepoint >= 0xD800 && codepoint <= 0xDFFF)
+      || codepoint > 0x10'FFFF)
+  {
+    return 0;
+  }
+
+  return character_w;
+}
+
+
+#if defined(x86_kernels_included)
+
+/*
+  SSE2 examines 16 bytes at a time.
+
+  To classify bytes, we compare all 16 with ' ', then '\t'. Each
+  comparison gives us 0xFF where a byte matched, which we turn
+  into the class we want with '&'. Bytes with their top bit set
+  are "negative", so a signed comparison with 0 finds those.
+*/
+__attribute__((target("sse2")))
+void ClassifyBytesSSE2(Text bytes, Size bytes_w, Byte classes[])
+{
+  auto spaces = _mm_set1_epi8(' ');
+  auto tabs = _mm_set1_epi8('\t');
+  auto zeros = _mm_setzero_si128();
+
+  Offset bytes_o = 0;
+
+  for (; bytes_o + 16 <= bytes_w; bytes_o += 16)
+  {
+    auto some_bytes = _mm_loadu_si128((const __m128i *) (bytes + bytes_o));
+
+    auto some_classes = _mm_or_si128(
+      _mm_or_si128(
+        _mm_and_si128(
+          _mm_cmpeq_epi8(some_bytes, spaces),
+          _mm_set1_epi8(SpaceByte)),
+        _mm_and_si128(
+          _mm_cmpeq_epi8(some_bytes, tabs),
+          _mm_set1_epi8(TabByte))),
+      _mm_and_si128(
+        _mm_cmplt_epi8(some_bytes, zeros),
+        _mm_set1_epi8(MultibyteByte)));
+
+    _mm_storeu_si128((__m128i *) (classes + bytes_o), some_classes);
+  }
+
+  ClassifyBytesScalar(bytes + bytes_o, bytes_w - bytes_o, classes + bytes_o);
+}
+
+
+/*
+  Most T source is plain ASCII, so we skip 16 bytes at a time
+  while their top bits are all 0. Where they aren't, we validate
+  each character the careful way.
+*/
+__attribute__((target("sse2")))
+Size ValidUTF8WidthSSE2(Text text, Size text_w)
+{
+  const Byte *bytes = (const Byte*) text;
+  Offset text_o = 0;
+
+  while (text_o < text_w)
+  {
+    if (text_o + 16 <= text_w
+        && _mm_movemask_epi8(
+             _mm_loadu_si128((const __m128i *) (bytes + text_o))) == 0)
+    {
+      text_o += 16;
+      continue;
+    }
+
+    // Validate characters until we're past these 16 bytes.
+    auto just_after_chunk_o = text_o + 16;
+
+    while (text_o < text_w && text_o < just_after_chunk_o)
+    {
+      auto character_w = ValidUTF8CharacterWidth(
+        bytes + text_o,
+        text_w - text_o);
+
+      if (character_w == 0)
+      {
+        return text_o;
+      }
+
+      text_o += character_w;
+    }
+  }
+
+  return text_w;
+}
+
+
+/*
+  One instruction compares 16 bytes with '\n', and another
+  squishes the results into a 16-bit "mask", with one bit per
+  byte. Each 1 bit marks a newline.
+*/
+__attribute__((target("sse2")))
+void IndexNewlinesSSE2(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator)
+{
+  auto newlines = _mm_set1_epi8('\n');
+  auto source_o = from_o;
+
+  for (; source_o + 16 <= source_w; source_o += 16)
+  {
+    auto bytes = _mm_loadu_si128((const __m128i *) (source + source_o));
+
+    uint32_t newline_mask =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newlines));
+
+    if (newline_mask == 0)
+    {
+      continue;
+    }
+
+    Offset *line_start_os = TaggedAllocate(
+      allocator,
+      __builtin_popcount(newline_mask) * sizeof (Offset),
+      LineIndexAllocation);
+
+    // Each trailing 0 bit is a byte that isn't a newline.
+    while (newline_mask != 0)
+    {
+      *line_start_os = source_o + __builtin_ctz(newline_mask) + 1;
+      line_start_os += 1;
+
+      // Clear the lowest 1 bit.
+      newline_mask &= newline_mask - 1;
+    }
+  }
+
+  // Whatever's left, the scalar kernel handles.
+  IndexNewlinesScalar(source, source_w, source_o, allocator);
+}
+
+
+// Just like 'ClassifyBytesSSE2', but 32 bytes at a time.
+__attribute__((target("avx2")))
+void ClassifyBytesAVX2(Text bytes, Size bytes_w, Byte classes[])
+{
+  auto spaces = _mm256_set1_epi8(' ');
+  auto tabs = _mm256_set1_epi8('\t');
+  auto zeros = _mm256_setzero_si256();
+
+  Offset bytes_o = 0;
+
+  for (; bytes_o + 32 <= bytes_w; bytes_o += 32)
+  {
+    auto some_bytes =
+      _mm256_loadu_si256((const __m256i *) (bytes + bytes_o));
+
+    auto some_classes = _mm256_or_si256(
+      _mm256_or_si256(
+        _mm256_and_si256(
+          _mm256_cmpeq_epi8(some_bytes, spaces),
+          _mm256_set1_epi8(SpaceByte)),
+        _mm256_and_si256(
+          _mm256_cmpeq_epi8(some_bytes, tabs),
+          _mm256_set1_epi8(TabByte))),
+      _mm256_and_si256(
+        _mm256_cmpgt_epi8(zeros, some_bytes),
+        _mm256_set1_epi8(MultibyteByte)));
+
+    _mm256_storeu_si256((__m256i *) (classes + bytes_o), some_classes);
+  }
+
+  // (SSE2 can handle whatever's left.)
+  ClassifyBytesSSE2(bytes + bytes_o, bytes_w - bytes_o, classes + bytes_o);
+}
+
+
+// Just like 'ValidUTF8WidthSSE2', but 32 bytes at a time.
+__attribute__((target("avx2")))
+Size ValidUTF8WidthAVX2(Text text, Size text_w)
+{
+  const Byte *bytes = (const Byte*) text;
+  Offset text_o = 0;
+
+  while (text_o < text_w)
+  {
+    if (text_o + 32 <= text_w
+        && _mm256_movemask_epi8(
+             _mm256_loadu_si256((const __m256i *) (bytes + text_o))) == 0)
+    {
+      text_o += 32;
+      continue;
+    }
+
+    // Validate characters until we're past these 32 bytes.
+    auto just_after_chunk_o = text_o + 32;
+
+    while (text_o < text_w && text_o < just_after_chunk_o)
+    {
+      auto character_w = ValidUTF8CharacterWidth(
+        bytes + text_o,
+        text_w - text_o);
+
+      if (character_w == 0)
+      {
+        return text_o;
+      }
+
+      text_o += character_w;
+    }
+  }
+
+  return text_w;
+}
+
+
+// Just like 'IndexNewlinesSSE2', but 32 bytes at a time.
+__attribute__((target("avx2")))
+void IndexNewlinesAVX2(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator)
+{
+  auto newlines = _mm256_set1_epi8('\n');
+  auto source_o = from_o;
+
+  for (; source_o + 32 <= source_w; source_o += 32)
+  {
+    auto bytes = _mm256_loadu_si256((const __m256i *) (source + source_o));
+
+    uint32_t newline_mask =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newlines));
+
+    if (newline_mask == 0)
+    {
+      continue;
+    }
+
+    Offset *line_start_os = TaggedAllocate(
+      allocator,
+      __builtin_popcount(newline_mask) * sizeof (Offset),
+      LineIndexAllocation);
+
+    while (newline_mask != 0)
+    {
+      *line_start_os = source_o + __builtin_ctz(newline_mask) + 1;
+      line_start_os += 1;
+
+      newline_mask &= newline_mask - 1;
+    }
+  }
+
+  IndexNewlinesScalar(source, source_w, source_o, allocator);
+}
+
+
+/*
+  AVX-512 examines 64 bytes at a time. Its comparisons give us
+  masks directly, one bit per byte, and it can load and store
+  just the bytes a mask picks out. So we can handle the last few
+  bytes the same way as all the others!
+*/
+__attribute__((target("avx512f,avx512bw")))
+void ClassifyBytesAVX512(Text bytes, Size bytes_w, Byte classes[])
+{
+  auto spaces = _mm512_set1_epi8(' ');
+  auto tabs = _mm512_set1_epi8('\t');
+
+  for (Offset bytes_o = 0; bytes_o < bytes_w; bytes_o += 64)
+  {
+    // Which of these 64 bytes are actually ours?
+    auto remaining_w = bytes_w - bytes_o;
+    __mmask64 ours = (remaining_w >= 64) ? ~0ull : (1ull << remaining_w) - 1;
+
+    auto some_bytes = _mm512_maskz_loadu_epi8(ours, bytes + bytes_o);
+
+    auto some_classes = _mm512_or_si512(
+      _mm512_or_si512(
+        _mm512_maskz_mov_epi8(
+          _mm512_cmpeq_epi8_mask(some_bytes, spaces),
+          _mm512_set1_epi8(SpaceByte)),
+        _mm512_maskz_mov_epi8(
+          _mm512_cmpeq_epi8_mask(some_bytes, tabs),
+          _mm512_set1_epi8(TabByte))),
+      _mm512_maskz_mov_epi8(
+        _mm512_movepi8_mask(some_bytes),
+        _mm512_set1_epi8(MultibyteByte)));
+
+    _mm512_mask_storeu_epi8(classes + bytes_o, ours, some_classes);
+  }
+}
+
+
+// Just like 'ValidUTF8WidthSSE2', but 64 bytes at a time.
+__attribute__((target("avx512f,avx512bw")))
+Size ValidUTF8WidthAVX512(Text text, Size text_w)
+{
+  const Byte *bytes = (const Byte*) text;
+  Offset text_o = 0;
+
+  while (text_o < text_w)
+  {
+    if (text_o + 64 <= text_w
+        && _mm512_movepi8_mask(_mm512_loadu_si512(bytes + text_o)) == 0)
+    {
+      text_o += 64;
+      continue;
+    }
+
+    // Validate characters until we're past these 64 bytes.
+    auto just_after_chunk_o = text_o + 64;
+
+    while (text_o < text_w && text_o < just_after_chunk_o)
+    {
+      auto character_w = ValidUTF8CharacterWidth(
+        bytes + text_o,
+        text_w - text_o);
+
+      if (character_w == 0)
+      {
+        return text_o;
+      }
+
+      text_o += character_w;
+    }
+  }
+
+  return text_w;
+}
+
+
+// Just like 'IndexNewlinesSSE2', but 64 bytes at a time.
+__attribute__((target("avx512f,avx512bw,popcnt")))
+void IndexNewlinesAVX512(
+  Text source,
+  Size source_w,
+  Offset from_o,
+  struct Allocator *allocator)
+{
+  auto newlines = _mm512_set1_epi8('\n');
+  auto source_o = from_o;
+
+  for (; source_o + 64 <= source_w; source_o += 64)
+  {
+    uint64_t newline_mask = _mm512_cmpeq_epi8_mask(
+      _mm512_loadu_si512(source + source_o),
+      newlines);
+
+    if (newline_mask == 0)
+    {
+      continue;
+    }
+
+    Offset *line_start_os = TaggedAllocate(
+      allocator,
+      __builtin_popcountll(newline_mask) * sizeof (Offset),
+      LineIndexAllocation);
+
+    while (newline_mask != 0)
+    {
+      *line_start_os = source_o + __builtin_ctzll(newline_mask) + 1;
+      line_start_os += 1;
+
+      newline_mask &= newline_mask - 1;
+    }
+  }
+
+  IndexNewlinesScalar(source, source_w, source_o, allocator);
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef kernels_h_already_included
+#define kernels_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+
+
+/*
+  What kind of byte is this, as far as the tokenizer's concerned?
+
+  Most bytes are plain ASCII code. The tokenizer can handle those
+  without decoding anything.
+*/
+enum ByteClass: Byte
+{
+  CodeByte = 0,
+  SpaceByte = 1,
+  TabByte = 2,
+  // (Part of a character that's wider than a byte.)
+  MultibyteByte = 4
+};
+
+/*
+  The compiler's hottest loops, or "kernels", come in several
+  versions, one for each generation of processor: plain C, SSE2,
+  AVX2 and AVX-512. They all give exactly the same results; the
+  newer ones just examine more bytes at once.
+
+  Every version is built into the same program. When we start
+  up, we ask the processor what it supports, and pick the best
+  set of kernels it can run. (See 'ActiveKernels'.)
+*/
+struct KernelSet
+{
+  // "scalar", "sse2", "avx2" or "avx512".
+  Text name;
+
+  // Writes each byte's 'ByteClass' to 'classes'.
+  void (*ClassifyBytes)(Text bytes, Size bytes_w, Byte classes[]);
+
+  /*
+    How many bytes at the start of this text are valid UTF-8? (If
+    it's all valid, that's the whole text.)
+  */
+  Size (*ValidUTF8Width)(Text text, Size text_w);
+
+  /*
+    Allocates the offset just after each newline character in the
+    source text, starting at the provided offset. (See
+    'LineIndex'.)
+  */
+  void (*IndexNewlines)(
+    Text source,
+    Size source_w,
+    Offset from_o,
+    struct Allocator *allocator);
+};
+
+const struct KernelSet *ActiveKernels();
+
+void UseKernels(Text name);
+
+#endif
@@ -0,0 +1,122 @@
+#include "line_index.h"
+#include "common_data_types.h"
+#include "kernels.h"
+#include "memory.h"
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// These three bytes start UTF-8 text with a "byte order mark".
+constexpr Byte utf8_byte_order_mark[] = { 0xEF, 0xBB, 0xBF };
+
+
+/*
+  This constructor indexes every line of the source text in a
+  single pass.
+
+  The line starts are allocated one after another, so nothing
+  else may allocate from the allocator until we're done.
+*/
+struct LineIndex LineIndex(
+  // The source text we're indexing.
+  Text source,
+  // How many bytes wide is it?
+  Size source_w,
+  // Our trusty allocator.
+  struct Allocator *allocator)
+{
+  // Skip the byte order mark, if there is one.
+  Offset first_line_start_o = 0;
+
+  if (source_w >= sizeof utf8_byte_order_mark
+      && memcmp(
+           source,
+           utf8_byte_order_mark,
+           sizeof utf8_byte_order_mark) == 0)
+  {
+    first_line_start_o = sizeof utf8_byte_order_mark;
+  }
+
+  // Make sure our offsets are properly aligned.
+  auto misalignment_w =
+    (uintptr_t) NextAddressToAllocate(allocator) % alignof(Offset);
+
+  if (misalignment_w != 0)
+  {
+    TaggedAllocate(
+      allocator,
+      alignof(Offset) - misalignment_w,
+      LineIndexAllocation);
+  }
+
+  // The first line starts first. (Obviously!)
+  Offset *line_start_os = TaggedAllocate(
+    allocator,
+    sizeof (Offset),
+    LineIndexAllocation);
+  line_start_os[0] = first_line_start_o;
+
+  // Every other line starts just after a newline character.
+  ActiveKernels()->IndexNewlines(
+    source,
+    source_w,
+    first_line_start_o,
+    allocator);
+
+  auto line_starts_w =
+    (Offset*) NextAddressToAllocate(allocator) - line_start_os;
+
+  /*
+    If the source text ends with a newline character (or it's
+    empty), the final line start we found is just past the end.
+    That's exactly the extra offset we need.
+
+    Otherwise, we add one, as if there were a newline at the end.
+  */
+  auto lines_w = line_starts_w - 1;
+
+  if (line_start_os[lines_w] != source_w)
+  {
+    Offset *just_after_end_o = TaggedAllocate(
+      allocator,
+      sizeof (Offset),
+      LineIndexAllocation);
+    *just_after_end_o = source_w + 1;
+
+    lines_w += 1;
+  }
+
+  return (struct LineIndex)
+  {
+    .source = source,
+    .source_w = source_w,
+    .line_start_os = line_start_os,
+    .lines_w = lines_w
+  };
+}
+
+
+// Where does this line start? (0 is the first line.)
+Text Line(const struct LineIndex *index, Offset line_o)
+{
+  return index->source + index->line_start_os[line_o];
+}
+
+
+// How many bytes wide is this line, without "\n" or "\r\n"?
+Size LineWidth(const struct LineIndex *index, Offset line_o)
+{
+  auto line_start_o = index->line_start_os[line_o];
+
+  // The line ends right before the next line's newline.
+  auto line_end_o = index->line_start_os[line_o + 1] - 1;
+
+  if (line_end_o > line_start_o
+      && index->source[line_end_o - 1] == '\r')
+  {
+    line_end_o -= 1;
+  }
+
+  return line_end_o - line_start_o;
+}
@@ -0,0 +1,45 @@
+#ifndef line_index_h_already_included
+#define line_index_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+
+
+/*
+  An index of where each line starts within some source text.
+
+  Given this source text:
+    "enum Gospel\r\n{\n  Mark\n}"
+
+  Here's the representation:
+    .line_start_os = { 0, 13, 15, 22, 24 },
+    .lines_w = 4
+
+  Note the extra offset at the very end. That's where the line
+  after the final line would start, as if the source text ended
+  with a newline character. Thanks to it, every line (even the
+  last one) ends right before the next line's start.
+
+  A UTF-8 "byte order mark" at the very start of the source text
+  isn't part of the first line. Neither are the "\n" or "\r\n"
+  characters that end each line.
+*/
+struct LineIndex
+{
+  Text source;
+  Size source_w;
+
+  Offset *line_start_os;
+  Size lines_w;
+};
+
+struct LineIndex LineIndex(
+  Text source,
+  Size source_w,
+  struct Allocator *allocator);
+
+Text Line(const struct LineIndex *index, Offset line_o);
+
+Size LineWidth(const struct LineIndex *index, Offset line_o);
+
+#endif
@@ -0,0 +1,334 @@
+#include "line_memo.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+#include "memory.h"
+#include "tokenizing.h"
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+
+Size LineHash(Text line, Size line_w);
+
+struct MemoizedLine *LineMemoSet(
+  struct LineMemo *memo,
+  Size hash,
+  struct LineMemoStripe **stripe);
+
+
+// If this thread is using a line memo, this points to it.
+static thread_local struct LineMemo *current_memo = NULL;
+
+// How has the memo done so far? (Across every thread.)
+static atomic_size_t memo_lookups_w;
+static atomic_size_t memo_hits_w;
+static atomic_size_t memo_evictions_w;
+
+
+/*
+  This constructor prepares an empty line memo. All of its memory
+  comes from the provided allocator, up front.
+*/
+struct LineMemo LineMemo(
+  // Our trusty allocator.
+  struct Allocator *allocator)
+{
+  auto stripes_w = line_memo_stripes_w * sizeof (struct LineMemoStripe);
+
+  // Make sure the stripes are properly aligned.
+  auto misalignment_w =
+    (uintptr_t) NextAddressToAllocate(allocator)
+    % alignof(struct LineMemoStripe);
+
+  if (misalignment_w != 0)
+  {
+    TaggedAllocate(
+      allocator,
+      alignof(struct LineMemoStripe) - misalignment_w,
+      LineMemoAllocation);
+  }
+
+  struct LineMemoStripe *stripes =
+    TaggedAllocate(allocator, stripes_w, LineMemoAllocation);
+
+  // Every entry starts out empty.
+  memset(stripes, 0, stripes_w);
+
+  for (Offset i = 0; i < line_memo_stripes_w; i++)
+  {
+    mtx_init(&stripes[i].mutex, mtx_plain);
+  }
+
+  return (struct LineMemo) { .stripes = stripes };
+}
+
+
+// We're done with the memo. (Its memory goes with its allocator.)
+void ReleaseLineMemo(struct LineMemo *memo)
+{
+  for (Offset i = 0; i < line_memo_stripes_w; i++)
+  {
+    mtx_destroy(&memo->stripes[i].mutex);
+  }
+}
+
+
+/*
+  From now on, this thread recalls and memorizes tokenized lines
+  using the provided memo. (Several threads can share one memo.)
+
+  Pass NULL to stop.
+*/
+void UseLineMemo(struct LineMemo *memo)
+{
+  current_memo = memo;
+}
+
+
+/*
+  Have we tokenized this exact line before? If so, we copy its
+  tokens into the allocator, just as if we'd tokenized it, and
+  return true.
+
+  (If this thread isn't using a memo, we always return false.)
+*/
+YesNo RecallTokenizedLine(
+  // (This needn't be null-terminated.)
+  Text line,
+  Size line_w,
+  // Our trusty allocator.
+  struct Allocator *allocator,
+  // Where do we write the tokenized line?
+  struct TokenizedLine *tokenized)
+{
+  auto memo = current_memo;
+
+  if (memo == NULL || line_w > max_memoized_line_w)
+  {
+    return false;
+  }
+
+  atomic_fetch_add_explicit(&memo_lookups_w, 1, memory_order_relaxed);
+
+  auto hash = LineHash(line, line_w);
+  struct LineMemoStripe *stripe;
+  auto set = LineMemoSet(memo, hash, &stripe);
+
+  /*
+    We copy the entry out while we hold the lock. That way, it
+    can't change underneath us, and we never allocate (which
+    might exit) while holding the lock.
+  */
+  struct MemoizedLine recalled;
+  auto found = false;
+
+  mtx_lock(&stripe->mutex);
+
+  stripe->clock += 1;
+
+  for (Offset way = 0; way < line_memo_ways_w; way++)
+  {
+    auto entry = &set[way];
+
+    if (entry->last_used != 0
+        && entry->hash == hash
+        && entry->line_w == line_w
+        && memcmp(entry->line, line, line_w) == 0)
+    {
+      entry->last_used = stripe->clock;
+      recalled = *entry;
+      found = true;
+      break;
+    }
+  }
+
+  mtx_unlock(&stripe->mutex);
+
+  if (found == false)
+  {
+    return false;
+  }
+
+  atomic_fetch_add_explicit(&memo_hits_w, 1, memory_order_relaxed);
+
+  Text *tokens = TaggedAllocate(
+    allocator,
+    recalled.tokens_w * sizeof (Text),
+    TokenArrayAllocation);
+
+  Text token_text = TaggedAllocateCopy(
+    allocator,
+    recalled.token_text,
+    recalled.token_text_w,
+    TokenTextAllocation);
+
+  for (Offset i = 0; i < recalled.tokens_w; i++)
+  {
+    tokens[i] = token_text + recalled.token_os[i];
+  }
+
+  *tokenized = (struct TokenizedLine)
+  {
+    .indent_level = recalled.indent_level,
+    .tokens = (recalled.tokens_w > 0) ? tokens : NULL,
+    .tokens_w = recalled.tokens_w
+  };
+
+  return true;
+}
+
+
+/*
+  Remembers how this line was tokenized, so next time, we can
+  recall it instead. (See 'RecallTokenizedLine'.)
+
+  Only memorize lines that tokenized cleanly. If the tokenizer
+  reported a problem, it needs to report it again next time.
+*/
+void MemorizeTokenizedLine(
+  // (This needn't be null-terminated.)
+  Text line,
+  Size line_w,
+  const struct TokenizedLine *tokenized)
+{
+  auto memo = current_memo;
+
+  if (memo == NULL || line_w > max_memoized_line_w)
+  {
+    return;
+  }
+
+  // Let's prepare the entry before we take the lock.
+  struct MemoizedLine memorized =
+  {
+    .hash = LineHash(line, line_w),
+    .line_w = line_w,
+    .indent_level = tokenized->indent_level,
+    .tokens_w = tokenized->tokens_w
+  };
+
+  memcpy(memorized.line, line, line_w);
+
+  for (Offset i = 0; i < tokenized->tokens_w; i++)
+  {
+    auto token_w = strlen(tokenized->tokens[i]) + 1;
+
+    // (This only happens for unusual lines, so we skip them.)
+    if (memorized.token_text_w + token_w > sizeof memorized.token_text)
+    {
+      return;
+    }
+
+    memorized.token_os[i] = memorized.token_text_w;
+
+    memcpy(
+      &memorized.token_text[memorized.token_text_w],
+      tokenized->tokens[i],
+      token_w);
+
+    memorized.token_text_w += token_w;
+  }
+
+  struct LineMemoStripe *stripe;
+  auto set = LineMemoSet(memo, memorized.hash, &stripe);
+
+  mtx_lock(&stripe->mutex);
+
+  stripe->clock += 1;
+  memorized.last_used = stripe->clock;
+
+  /*
+    Which entry makes way? An empty one, if there is one.
+    Otherwise, the least recently used.
+
+    (If another thread memorized this line in the meantime, we
+    just replace its entry with an identical one.)
+  */
+  auto replaced = &set[0];
+
+  for (Offset way = 0; way < line_memo_ways_w; way++)
+  {
+    auto entry = &set[way];
+
+    if (entry->last_used == 0
+        || (entry->hash == memorized.hash
+            && entry->line_w == line_w
+            && memcmp(entry->line, line, line_w) == 0))
+    {
+      replaced = entry;
+      break;
+    }
+
+    if (entry->last_used < replaced->last_used)
+    {
+      replaced = entry;
+    }
+  }
+
+  if (replaced->last_used != 0 && replaced->hash != memorized.hash)
+  {
+    atomic_fetch_add_explicit(&memo_evictions_w, 1, memory_order_relaxed);
+  }
+
+  *replaced = memorized;
+
+  mtx_unlock(&stripe->mutex);
+}
+
+
+// If any thread used a line memo, reports how well it did.
+void ReportLineMemo(FILE *stream)
+{
+  auto lookups_w = atomic_load(&memo_lookups_w);
+
+  if (lookups_w == 0)
+  {
+    return;
+  }
+
+  auto hits_w = atomic_load(&memo_hits_w);
+
+  fprintf(
+    stream,
+    "  Line memo: %zu of %zu lines recalled (%.1f%%), %zu evicted\n",
+    hits_w,
+    lookups_w,
+    100.0 * hits_w / lookups_w,
+    atomic_load(&memo_evictions_w));
+}
+
+
+// Hashes a line's bytes. (That's FNV-1a.)
+Size LineHash(Text line, Size line_w)
+{
+  uint64_t hash = 0xcbf2'9ce4'8422'2325;
+
+  for (Offset i = 0; i < line_w; i++)
+  {
+    hash ^= (Byte) line[i];
+    hash *= 0x100'0000'01b3;
+  }
+
+  return hash;
+}
+
+
+/*
+  Which entries can a line with this hash live in? Also writes
+  which stripe they're in (and so, which lock guards them).
+*/
+struct MemoizedLine *LineMemoSet(
+  struct LineMemo *memo,
+  Size hash,
+  struct LineMemoStripe **stripe)
+{
+  *stripe = &memo->stripes[hash % line_memo_stripes_w];
+
+  auto set_o =
+    (hash / line_memo_stripes_w) % line_memo_sets_per_stripe_w;
+
+  return (*stripe)->entries[set_o];
+}
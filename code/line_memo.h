@@ -0,0 +1,89 @@
+#ifndef line_memo_h_already_included
+#define line_memo_h_already_included
+
+#include "common_data_types.h"
+#include "memory.h"
+#include "tokenizing.h"
+#include <stdio.h>
+#include <threads.h>
+
+
+// We only memoize lines up to this many bytes wide.
+constexpr Size max_memoized_line_w = max_line_length;
+
+/*
+  The memo is split into stripes, each with its own lock, so
+  workers rarely wait for each other. Within each stripe, every
+  line has a handful of entries ("ways") it can live in.
+*/
+constexpr Size line_memo_stripes_w = 64;
+constexpr Size line_memo_sets_per_stripe_w = 64;
+constexpr Size line_memo_ways_w = 4;
+
+// One line we've tokenized before, and its tokens.
+struct MemoizedLine
+{
+  // (0 means this entry is empty.)
+  Size last_used;
+
+  // A hash of the line's bytes. (See 'LineHash'.)
+  Size hash;
+
+  Size line_w;
+  Character line[max_memoized_line_w];
+
+  Size indent_level;
+  Size tokens_w;
+
+  // The text of every token, one after another, each with its
+  // trailing '\0'.
+  Character token_text[max_memoized_line_w + max_tokens_per_line];
+  Size token_text_w;
+
+  // Where does each token start within 'token_text'?
+  Byte token_os[max_tokens_per_line];
+};
+
+struct LineMemoStripe
+{
+  mtx_t mutex;
+
+  // Ticks once per lookup, so we can tell which entries were used
+  // least recently.
+  Size clock;
+
+  struct MemoizedLine entries[line_memo_sets_per_stripe_w][line_memo_ways_w];
+};
+
+/*
+  Remembers how lines were tokenized, so identical lines (even in
+  different files) are only tokenized once.
+
+  The memo never grows: once a line's entries are all taken, the
+  least recently used one makes way.
+*/
+struct LineMemo
+{
+  struct LineMemoStripe *stripes;
+};
+
+struct LineMemo LineMemo(struct Allocator *allocator);
+
+void ReleaseLineMemo(struct LineMemo *memo);
+
+void UseLineMemo(struct LineMemo *memo);
+
+YesNo RecallTokenizedLine(
+  Text line,
+  Size line_w,
+  struct Allocator *allocator,
+  struct TokenizedLine *tokenized);
+
+void MemorizeTokenizedLine(
+  Text line,
+  Size line_w,
+  const struct TokenizedLine *tokenized);
+
+void ReportLineMemo(FILE *stream);
+
+#endif
@@ -1,9 +1,30 @@
 #include "memory.h"
+#include "block_recycling.h"
 #include "common_data_types.h"
 #include "exit_due_to_error.h"
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+#endif
+
+
+// Transparent huge pages on x86-64 and ARM64 are 2 megabytes.
+constexpr Size huge_page_w = 2 * 1024 * 1024;
+
+// Without huge pages, we commit memory in 64-kilobyte steps.
+constexpr Size commit_step_w = 64 * 1024;
+
+
+Memory AllocateBytes(struct Allocator* allocator, Size allocation_w);
+
+void CommitMemory(struct Allocator *allocator, Size needed_w);
+
+Size RoundUp(Size size, Size multiple);
+
 
 // Returns a new memory allocator, provided a region of memory
 // for the allocator to control.
@@ -14,11 +35,131 @@ struct Allocator Allocator(
   return (struct Allocator)
   {
     .memory = memory_to_allocate_from,
-    .memory_w = memory_w
+    .memory_w = memory_w,
+    // We assume the provided memory is ready to go.
+    .committed_w = memory_w
+  };
+}
+
+
+/*
+  Returns a new memory allocator that controls a huge region of
+  virtual memory, without using any physical memory yet.
+
+  Q: What's the difference?
+
+  A: Reserving virtual memory just sets aside a range of
+     addresses. It's nearly free, even if the range is gigabytes
+     wide. As the allocator hands out memory, we "commit" pages
+     within that range, and only then does the operating system
+     back them with physical memory.
+
+  Because the range never moves, neither does anything we've
+  allocated. A reserved allocator can grow without copying, and
+  pointers into it stay valid.
+
+  If asked, we also hint that the operating system should use
+  huge pages. Bigger pages mean fewer TLB misses on big inputs.
+*/
+struct Allocator ReservedAllocator(
+  // How many bytes of virtual memory do we reserve?
+  Size reserve_w,
+  // Should we ask for (transparent) huge pages?
+  YesNo use_huge_pages)
+{
+  reserve_w = RoundUp(reserve_w, huge_page_w);
+
+#if defined(_WIN32)
+  // (Windows only grants huge pages to privileged processes, so
+  // we don't bother asking.)
+  use_huge_pages = false;
+
+  Memory memory =
+    VirtualAlloc(NULL, reserve_w, MEM_RESERVE, PAGE_NOACCESS);
+
+  if (memory == NULL)
+  {
+    ExitDueToError(
+      "The compiler couldn’t reserve %zu bytes of memory.\n",
+      reserve_w);
+  }
+#else
+  /*
+    Huge pages only work for ranges that start on a huge page
+    boundary. To be sure we can find one, we reserve an extra
+    huge page's worth, then give back the leftovers.
+  */
+  auto mapping_w = use_huge_pages ? reserve_w + huge_page_w : reserve_w;
+
+  // 'PROT_NONE' means "look, don't touch": just reserve it.
+  Memory mapping = mmap(
+    NULL,
+    mapping_w,
+    PROT_NONE,
+    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+    -1,
+    0);
+
+  if (mapping == MAP_FAILED)
+  {
+    ExitDueToError(
+      "The compiler couldn’t reserve %zu bytes of memory.\n",
+      mapping_w);
+  }
+
+  Byte *memory = mapping;
+
+  if (use_huge_pages)
+  {
+    auto mapping_start = (uintptr_t) mapping;
+    auto memory_start = RoundUp(mapping_start, huge_page_w);
+    auto leftover_before_w = memory_start - mapping_start;
+    auto leftover_after_w = huge_page_w - leftover_before_w;
+
+    memory = (Byte*) mapping + leftover_before_w;
+
+    if (leftover_before_w > 0)
+    {
+      munmap(mapping, leftover_before_w);
+    }
+
+    if (leftover_after_w > 0)
+    {
+      munmap(memory + reserve_w, leftover_after_w);
+    }
+
+  #if defined(MADV_HUGEPAGE)
+    // This is just a hint. If the operating system says no, we
+    // carry on with regular pages.
+    madvise(memory, reserve_w, MADV_HUGEPAGE);
+  #endif
+  }
+#endif
+
+  return (struct Allocator)
+  {
+    .memory = memory,
+    .memory_w = reserve_w,
+    .committed_w = 0,
+    .uses_huge_pages = use_huge_pages
   };
 }
 
 
+// Gives a reserved allocator's memory back to the operating
+// system. Everything it allocated is gone!
+void ReleaseReservedAllocator(struct Allocator *allocator)
+{
+#if defined(_WIN32)
+  VirtualFree(allocator->memory, 0, MEM_RELEASE);
+#else
+  munmap(allocator->memory, allocator->memory_w);
+#endif
+
+  *allocator = (struct Allocator) {};
+}
+
+
 /*
   The next time we allocate memory, which address will our
   allocator provide?
@@ -55,22 +196,95 @@ Memory Allocate(
   struct Allocator* allocator,
   // How many bytes do we need to allocate?
   Size allocation_w)
+{
+#if defined(T_TRACE_ALLOCATIONS)
+  return TaggedAllocate(allocator, allocation_w, UntaggedAllocation);
+#else
+  return AllocateBytes(allocator, allocation_w);
+#endif
+}
+
+
+// Copies into the given allocator.
+Memory AllocateCopy(
+  // Copy into this allocator.
+  struct Allocator* allocator,
+  // Where are we copying from?
+  Memory copy_from,
+  // How many bytes are we copying?
+  Size copy_w)
+{
+  auto copy_to = Allocate(allocator, copy_w);
+  return memcpy(copy_to, copy_from, copy_w);
+}
+
+
+#if defined(T_TRACE_ALLOCATIONS)
+
+// Allocates, then makes a note of what the allocation is for.
+Memory TaggedAllocate(
+  struct Allocator* allocator,
+  // How many bytes do we need to allocate?
+  Size allocation_w,
+  // What are they for?
+  enum AllocationTag tag)
+{
+  auto allocation = AllocateBytes(allocator, allocation_w);
+
+  TraceAllocation(tag, allocation_w, allocator->allocated_w);
+
+  return allocation;
+}
+
+
+// Copies into the given allocator, then makes a note of what the
+// copy is for.
+Memory TaggedAllocateCopy(
+  struct Allocator* allocator,
+  Memory copy_from,
+  Size copy_w,
+  enum AllocationTag tag)
+{
+  auto copy_to = TaggedAllocate(allocator, copy_w, tag);
+  return memcpy(copy_to, copy_from, copy_w);
+}
+
+#endif
+
+
+/*
+  This is where 'Allocate' and 'TaggedAllocate' actually do their
+  allocating.
+*/
+Memory AllocateBytes(
+  struct Allocator* allocator,
+  Size allocation_w)
 {
   // Do we need more bytes than this allocator has available?
-  if (allocation_w > (allocator->memory_w - allocator->allocated_w))
+  if (allocation_w > (allocator->memory_w - allocator->allocated_w)
+      // (Recycling allocators can simply move on to a fresh
+      // block, as long as the allocation fits in one.)
+      && (allocator->recycler == NULL
+          || MoveToFreshBlock(allocator, allocation_w) == false))
   {
     // This allocator wasn't given enough memory. Let's exit our
     // program then go fix the bug.
     ExitDueToError(
       "Allocator ran out of memory!\n"
       "  Requested: %zu bytes\n"
-      "  Total: %zu bytes\n",
+      "  Total: %zu bytes\n"
       "  Used: %zu bytes\n",
       allocation_w,
       allocator->memory_w,
       allocator->allocated_w);
   }
 
+  // Reserved allocators commit more memory as they go.
+  if (allocation_w > (allocator->committed_w - allocator->allocated_w))
+  {
+    CommitMemory(allocator, allocator->allocated_w + allocation_w);
+  }
+
   // Record the memory address we're allocating into.
   auto allocation = NextAddressToAllocate(allocator);
 
@@ -81,22 +295,80 @@ Memory Allocate(
 }
 
 
-// Copies into the given allocator.
-Memory AllocateCopy(
-  // Copy into this allocator.
-  struct Allocator* allocator,
-  // Where are we copying from?
-  Memory copy_from,
-  // How many bytes are we copying?
-  Size copy_w)
+/*
+  Gives back the most recently allocated bytes, so they can be
+  allocated again.
+
+  (This is handy when we allocate more than we turn out to need.)
+*/
+void GiveBackBytes(struct Allocator* allocator, Size bytes_w)
 {
-  auto copy_to = Allocate(allocator, copy_w);
-  return memcpy(copy_to, copy_from, copy_w);
+  allocator->allocated_w -= bytes_w;
 }
 
 
-// Performs a factory reset on the given allocator.
+/*
+  Performs a factory reset on the given allocator.
+
+  (A reserved allocator keeps the memory it has committed, so its
+  pages stay warm for next time.)
+*/
 void ResetAllocator(struct Allocator* allocator)
 {
+  // Recycling allocators have blocks to give back.
+  if (allocator->recycler != NULL)
+  {
+    ResetRecyclingAllocator(allocator);
+    return;
+  }
+
   allocator->allocated_w = 0;
-}
\ No newline at end of file
+}
+
+
+/*
+  Commits enough of a reserved allocator's memory to cover the
+  first 'needed_w' bytes.
+
+  We commit in generous steps, so we rarely need to come back.
+*/
+void CommitMemory(struct Allocator *allocator, Size needed_w)
+{
+  auto step_w = allocator->uses_huge_pages ? huge_page_w : commit_step_w;
+  auto committed_w = RoundUp(needed_w, step_w);
+
+  // (We never commit beyond the reserved range.)
+  if (committed_w > allocator->memory_w)
+  {
+    committed_w = allocator->memory_w;
+  }
+
+  // Where does the not-yet-committed memory start?
+  auto uncommitted = (Byte*) allocator->memory + allocator->committed_w;
+  auto commit_w = committed_w - allocator->committed_w;
+
+#if defined(_WIN32)
+  auto did_commit =
+    VirtualAlloc(uncommitted, commit_w, MEM_COMMIT, PAGE_READWRITE)
+    != NULL;
+#else
+  auto did_commit =
+    mprotect(uncommitted, commit_w, PROT_READ | PROT_WRITE) == 0;
+#endif
+
+  if (did_commit == false)
+  {
+    ExitDueToError(
+      "The compiler couldn’t commit %zu more bytes of memory.\n",
+      commit_w);
+  }
+
+  allocator->committed_w = committed_w;
+}
+
+
+// Rounds the size up to the nearest multiple.
+Size RoundUp(Size size, Size multiple)
+{
+  return (size + multiple - 1) / multiple * multiple;
+}
@@ -1,11 +1,15 @@
 #ifndef memory_h_already_included
 #define memory_h_already_included
 
+#include "allocation_tracing.h"
 #include "common_data_types.h"
 
 
 constexpr auto pointer_width = sizeof (void*);
 
+// (See "block_recycling.h".)
+struct BlockRecycler;
+
 // An "arena allocator". TODO: Explain!
 struct Allocator
 {
@@ -17,12 +21,37 @@ struct Allocator
 
   // How many bytes have been allocated?
   Size allocated_w;
+
+  /*
+    How many bytes are actually backed by physical memory?
+
+    For most allocators, that's all of them. Reserved allocators
+    (see 'ReservedAllocator') start with none, then commit more
+    as they go.
+  */
+  Size committed_w;
+
+  // Did we ask the operating system for huge pages?
+  YesNo uses_huge_pages;
+
+  /*
+    If this isn't NULL, this allocator is a recycling allocator
+    (see 'RecyclingAllocator'). Whenever its current block is
+    full, it moves on to a fresh block from this recycler.
+  */
+  struct BlockRecycler *recycler;
 };
 
 struct Allocator Allocator(
   Memory memory,
   Size memory_w);
 
+struct Allocator ReservedAllocator(
+  Size reserve_w,
+  YesNo use_huge_pages);
+
+void ReleaseReservedAllocator(struct Allocator *allocator);
+
 Memory NextAddressToAllocate(const struct Allocator* allocator);
 
 Memory Allocate(
@@ -35,6 +64,38 @@ Memory AllocateCopy(
   Memory copy_from,
   Size copy_w);
 
+/*
+  These work just like 'Allocate' and 'AllocateCopy', but they
+  also say what the allocation is for. (See 'AllocationTag'.)
+
+  Unless the compiler is built with allocation tracing, the tags
+  disappear before they're ever compiled, so they cost nothing.
+*/
+#if defined(T_TRACE_ALLOCATIONS)
+
+Memory TaggedAllocate(
+  struct Allocator* allocator,
+  Size allocation_w,
+  enum AllocationTag tag);
+
+Memory TaggedAllocateCopy(
+  struct Allocator* allocator,
+  Memory copy_from,
+  Size copy_w,
+  enum AllocationTag tag);
+
+#else
+
+#define TaggedAllocate(allocator, allocation_w, tag) \
+  Allocate(allocator, allocation_w)
+
+#define TaggedAllocateCopy(allocator, copy_from, copy_w, tag) \
+  AllocateCopy(allocator, copy_from, copy_w)
+
+#endif
+
+void GiveBackBytes(struct Allocator* allocator, Size bytes_w);
+
 void ResetAllocator(struct Allocator* allocator);
 
 #endif
@@ -0,0 +1,421 @@
+#include "performance_counters.h"
+#include "common_data_types.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+
+// The processor events we count during each phase.
+enum HardwareEvent
+{
+  CyclesEvent,
+  InstructionsEvent,
+  BranchMissesEvent,
+  L1DataMissesEvent,
+  LastLevelCacheMissesEvent,
+
+  // (This isn't an event. It's how many events there are.)
+  hardware_events_w
+};
+
+// Everything we counted during one phase.
+struct PhaseCounts
+{
+  // Did the phase run while we were counting?
+  YesNo counted;
+
+  // How many bytes of T source did it work through?
+  Size bytes_w;
+
+  // (Only for the events the processor could count.)
+  Size event_counts[hardware_events_w];
+  YesNo event_counted[hardware_events_w];
+};
+
+
+void ReportEventRate(
+  FILE *stream,
+  Text name,
+  const struct PhaseCounts *counts,
+  enum HardwareEvent event);
+
+
+static const Text phase_names[compiler_phases_w] =
+{
+  [ReadingPhase] = "Reading",
+  [TokenizingPhase] = "Tokenizing",
+  [RenderingPhase] = "Rendering"
+};
+
+// Are we counting hardware events at all?
+static YesNo counts_hardware_events = false;
+
+/*
+  Each phase has a thread of its own, and only that thread writes
+  to the phase's counts. We only read them once every thread is
+  done.
+*/
+static struct PhaseCounts phase_counts[compiler_phases_w];
+
+/*
+  If the operating system wouldn't let us count anything, why
+  not? (0 means it did.) Any phase's thread can find out, so
+  they share this carefully.
+*/
+static _Atomic Integer counting_error_number = 0;
+
+#if defined(__linux__)
+
+// How do we ask Linux to count each event?
+static const struct { __u32 type; __u64 config; } event_configs[] =
+{
+  [CyclesEvent] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  [InstructionsEvent] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  [BranchMissesEvent] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  [L1DataMissesEvent] =
+    {
+      PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D
+      | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+      | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+    },
+  [LastLevelCacheMissesEvent] =
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+};
+
+/*
+  The current thread's event counters, one file descriptor each.
+  (-1 means we couldn't count that event.)
+
+  They're all one group, led by the cycles counter, so the kernel
+  always counts them together, and we can switch them all on and
+  off at once.
+*/
+static thread_local Integer event_descriptors[hardware_events_w];
+
+// Has the current thread opened its counters (and not closed them)?
+static thread_local YesNo has_event_descriptors = false;
+
+#endif
+
+
+/*
+  From now on, we count hardware events, like cycles and cache
+  misses, during each phase of compiling. (See
+  'StartCountingPhase'.)
+
+  This only works on Linux, and only if the kernel allows it. (See
+  "/proc/sys/kernel/perf_event_paranoid".) Otherwise, we just
+  report why we couldn't.
+*/
+void StartCountingHardwareEvents()
+{
+  counts_hardware_events = true;
+}
+
+
+/*
+  The current thread starts working on this phase. Let's get
+  ready to count!
+
+  We don't actually count anything until 'ResumeCounting', so the
+  time spent waiting for another phase doesn't count. (And we only
+  count this thread's events, and only in user space.)
+*/
+void StartCountingPhase(enum CompilerPhase phase)
+{
+  if (counts_hardware_events == false)
+  {
+    return;
+  }
+
+#if defined(__linux__)
+  for (Offset event = 0; event < hardware_events_w; event++)
+  {
+    auto leader_descriptor = event_descriptors[CyclesEvent];
+
+    struct perf_event_attr attributes =
+    {
+      .type = event_configs[event].type,
+      .size = sizeof attributes,
+      .config = event_configs[event].config,
+      // The group starts out switched off. (See 'ResumeCounting'.)
+      .disabled = (event == CyclesEvent),
+      // (Counting the kernel usually needs special privileges.)
+      .exclude_kernel = 1,
+      .exclude_hv = 1,
+      // If there aren't enough counters to go around, the kernel
+      // takes turns. These let us scale the counts up to match.
+      .read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING
+    };
+
+    event_descriptors[event] = syscall(
+      SYS_perf_event_open,
+      &attributes,
+      // (This thread, on any processor.)
+      0,
+      -1,
+      // (The cycles counter starts the group.)
+      (event == CyclesEvent) ? -1 : leader_descriptor,
+      PERF_FLAG_FD_CLOEXEC);
+
+    if (event_descriptors[event] == -1 && event == CyclesEvent)
+    {
+      // If we can't even count cycles, we can't count anything.
+      atomic_store(&counting_error_number, errno);
+
+      for (; event < hardware_events_w; event++)
+      {
+        event_descriptors[event] = -1;
+      }
+    }
+  }
+
+  has_event_descriptors = true;
+#else
+  atomic_store(&counting_error_number, ENOSYS);
+#endif
+
+  phase_counts[phase].counted = true;
+}
+
+
+/*
+  The current thread is about to do some real work for its phase,
+  like tokenizing a batch of lines. Let's count it!
+*/
+void ResumeCounting()
+{
+#if defined(__linux__)
+  if (has_event_descriptors == false)
+  {
+    return;
+  }
+
+  auto leader_descriptor = event_descriptors[CyclesEvent];
+
+  if (leader_descriptor != -1)
+  {
+    ioctl(leader_descriptor, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+
+/*
+  The current thread is done with that work for now, and it's
+  about to wait for another phase. Let's not count that.
+*/
+void PauseCounting()
+{
+#if defined(__linux__)
+  if (has_event_descriptors == false)
+  {
+    return;
+  }
+
+  auto leader_descriptor = event_descriptors[CyclesEvent];
+
+  if (leader_descriptor != -1)
+  {
+    ioctl(leader_descriptor, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  }
+#endif
+}
+
+
+/*
+  The current thread is done with this phase, having worked
+  through this many bytes. Let's make a note of the counts.
+
+  (It's fine to call this while counting, or even if we never
+  started. If something went wrong partway through a phase, we
+  still want to let go of the counters.)
+*/
+void StopCountingPhase(enum CompilerPhase phase, Size bytes_w)
+{
+  if (counts_hardware_events == false)
+  {
+    return;
+  }
+
+  auto counts = &phase_counts[phase];
+  counts->bytes_w += bytes_w;
+
+#if defined(__linux__)
+  if (has_event_descriptors == false)
+  {
+    return;
+  }
+
+  has_event_descriptors = false;
+
+  for (Offset event = 0; event < hardware_events_w; event++)
+  {
+    auto descriptor = event_descriptors[event];
+
+    if (descriptor == -1)
+    {
+      continue;
+    }
+
+    // The count, how long it was enabled, and how long it ran.
+    __u64 values[3];
+
+    if (read(descriptor, values, sizeof values) == sizeof values
+        && values[2] > 0)
+    {
+      counts->event_counts[event] +=
+        (Size) ((double) values[0] * values[1] / values[2]);
+      counts->event_counted[event] = true;
+    }
+
+    close(descriptor);
+  }
+#endif
+}
+
+
+// Reports what we counted during each phase.
+void ReportHardwareEvents(FILE *stream)
+{
+  if (counts_hardware_events == false)
+  {
+    return;
+  }
+
+  Integer error_number = atomic_load(&counting_error_number);
+
+  if (error_number != 0)
+  {
+    Text reason;
+
+    switch (error_number)
+    {
+      case EACCES:
+      case EPERM:
+      {
+        reason =
+          "the kernel won’t allow it. "
+          "(See /proc/sys/kernel/perf_event_paranoid.)";
+        break;
+      }
+
+      case ENOENT:
+      case ENODEV:
+      case EOPNOTSUPP:
+      {
+        reason =
+          "this processor doesn’t offer them. "
+          "(Virtual machines often don’t.)";
+        break;
+      }
+
+      case ENOSYS:
+      {
+        reason = "this operating system doesn’t offer them.";
+        break;
+      }
+
+      default:
+      {
+        reason = strerror(error_number);
+        break;
+      }
+    }
+
+    fprintf(stream, "  Hardware events: unavailable, because %s\n", reason);
+    return;
+  }
+
+  auto counted_any_phase = false;
+
+  for (Offset phase = 0; phase < compiler_phases_w; phase++)
+  {
+    auto counts = &phase_counts[phase];
+
+    if (counts->counted == false)
+    {
+      continue;
+    }
+
+    counted_any_phase = true;
+
+    fprintf(
+      stream,
+      "  %s (%zu bytes):\n",
+      phase_names[phase],
+      counts->bytes_w);
+
+    ReportEventRate(stream, "Cycles", counts, CyclesEvent);
+    ReportEventRate(stream, "Instructions", counts, InstructionsEvent);
+
+    if (counts->event_counted[CyclesEvent]
+        && counts->event_counted[InstructionsEvent]
+        && counts->event_counts[CyclesEvent] > 0)
+    {
+      fprintf(
+        stream,
+        "    Instructions per cycle: %.2f\n",
+        (double) counts->event_counts[InstructionsEvent]
+        / counts->event_counts[CyclesEvent]);
+    }
+
+    ReportEventRate(stream, "Branch misses", counts, BranchMissesEvent);
+    ReportEventRate(stream, "L1 data misses", counts, L1DataMissesEvent);
+
+    ReportEventRate(
+      stream,
+      "Last-level cache misses",
+      counts,
+      LastLevelCacheMissesEvent);
+  }
+
+  // (Only single-file compilations are split into phases.)
+  if (counted_any_phase == false)
+  {
+    fprintf(stream, "  Hardware events: no phases to report\n");
+  }
+}
+
+
+// Reports one event's count, and how often it happened per byte.
+void ReportEventRate(
+  FILE *stream,
+  Text name,
+  const struct PhaseCounts *counts,
+  enum HardwareEvent event)
+{
+  if (counts->event_counted[event] == false)
+  {
+    fprintf(stream, "    %s: unavailable\n", name);
+    return;
+  }
+
+  auto count = counts->event_counts[event];
+
+  if (counts->bytes_w == 0)
+  {
+    fprintf(stream, "    %s: %zu\n", name, count);
+    return;
+  }
+
+  fprintf(
+    stream,
+    "    %s: %zu (%.4f per byte)\n",
+    name,
+    count,
+    (double) count / counts->bytes_w);
+}
@@ -0,0 +1,34 @@
+#ifndef performance_counters_h_already_included
+#define performance_counters_h_already_included
+
+#include "common_data_types.h"
+#include <stdio.h>
+
+
+/*
+  The phases of compiling a T source file, each with a thread of
+  its own. (See 'CompileTSourceInPipeline'.)
+*/
+enum CompilerPhase
+{
+  ReadingPhase,
+  TokenizingPhase,
+  RenderingPhase,
+
+  // (This isn't a phase. It's how many phases there are.)
+  compiler_phases_w
+};
+
+void StartCountingHardwareEvents();
+
+void StartCountingPhase(enum CompilerPhase phase);
+
+void ResumeCounting();
+
+void PauseCounting();
+
+void StopCountingPhase(enum CompilerPhase phase, Size bytes_w);
+
+void ReportHardwareEvents(FILE *stream);
+
+#endif
@@ -0,0 +1,612 @@
+#include "pipelining.h"
+#include "block_recycling.h"
+#include "common_data_types.h"
+#include "compiling.h"
+#include "diagnostics.h"
+#include "enum_resolving.h"
+#include "event_tracing.h"
+#include "exit_due_to_error.h"
+#include "line_index.h"
+#include "memory.h"
+#include "performance_counters.h"
+#include "ring_buffer.h"
+#include "tokenizing.h"
+#include <assert.h>
+#include <setjmp.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+
+// How many batches can wait between two stages?
+constexpr Size pipeline_ring_slots_w = 16;
+
+// How much T source does each batch of lines hold, at most?
+constexpr Size line_batch_text_w = 8 * 1024;
+
+// How many blocks can the pipeline use at once, in total?
+constexpr Size max_pipeline_blocks_w = 1024;
+
+// How much memory can the pipeline's diagnostics use, at most?
+constexpr Size max_diagnostics_w = 1024 * 1024 * 1024;
+
+// The same goes for the enum resolution pass.
+constexpr Size max_enum_resolution_w = 1024 * 1024 * 1024;
+
+/*
+  A batch of lines, straight from the T source. The batch, its
+  text and its line index all share one recycled block.
+*/
+struct LineBatch
+{
+  // What's the number of the batch's first line?
+  Offset first_line_number;
+
+  struct LineIndex lines;
+};
+
+/*
+  A batch of tokenized lines. The batch lives in its own
+  allocator's first block, along with all the tokens.
+*/
+struct TokenBatch
+{
+  struct Allocator allocator;
+
+  Offset first_line_number;
+  struct TokenizedLine *lines;
+  Size lines_w;
+
+  // How many bytes of T source did these lines come from?
+  Size source_w;
+};
+
+// Every batch must fit within one block, with a record per line.
+static_assert(
+  sizeof (struct TokenBatch)
+  + (1 + line_batch_text_w) * sizeof (struct TokenizedLine)
+  < recycled_block_w);
+
+/*
+  So must the batch's tokens, and so must their text. (See
+  'MaxTokensInLines'.) Each can move on to a fresh block, though.
+*/
+static_assert((1 + line_batch_text_w) * sizeof (Text) < recycled_block_w);
+static_assert(1 + 2 * line_batch_text_w < recycled_block_w);
+
+// So must every batch of lines, with its index.
+static_assert(
+  sizeof (struct LineBatch)
+  + line_batch_text_w
+  + (2 + line_batch_text_w) * sizeof (Offset)
+  < recycled_block_w);
+
+// Everything the pipeline's stages share.
+struct Pipeline
+{
+  FILE *t_source;
+  struct BlockRecycler *recycler;
+
+  // From the reading stage to the tokenizing stage.
+  struct RingBuffer line_batches;
+  Memory line_batch_slots[pipeline_ring_slots_w];
+
+  // From the tokenizing stage to the rendering stage.
+  struct RingBuffer token_batches;
+  Memory token_batch_slots[pipeline_ring_slots_w];
+
+  // Once tokenizing stops, there's no point reading any more.
+  atomic_bool stop_reading;
+
+  // The tokenizing stage's diagnostics.
+  struct Allocator diagnostics_allocator;
+  struct Diagnostics diagnostics;
+
+  /*
+    The tokenizing stage also feeds each line to the enum
+    resolution pass. (We render the results once it's done.)
+  */
+  struct Allocator enums_allocator;
+  struct EnumResolution enums;
+
+  // Did the tokenizing stage fail outright?
+  YesNo tokenizing_failed;
+
+  // (The tokenizing stage's work in progress.)
+  struct LineBatch *current_line_batch;
+  struct TokenBatch *current_token_batch;
+
+  // Has the tokenizing stage taken every batch it's going to?
+  YesNo took_every_line_batch;
+
+  // (How many bytes the tokenizing stage has finished with.)
+  Size tokenized_source_w;
+};
+
+
+Integer ReadLineBatches(Memory pipeline);
+
+Integer TokenizeLineBatches(Memory pipeline);
+
+void StopReading(struct Pipeline *pipeline);
+
+void LineTokenizedInPipeline(
+  const struct TokenizedLine *tokenized,
+  Offset line_number,
+  Memory pipeline);
+
+
+/*
+  Compiles T source code, just like 'CompileTSource', except the
+  work is split into three stages, each with its own thread:
+
+    1. Reading the T source, in batches of whole lines.
+    2. Tokenizing each batch of lines.
+    3. Rendering each batch of tokenized lines. (That's us.)
+
+  So while we're tokenizing one batch, we can be reading the next
+  one and rendering the previous one.
+
+  Between each stage is a ring buffer with room for a few
+  batches. If a stage gets too far ahead, it waits, so only a
+  handful of batches are ever in memory at once.
+
+  Any diagnostics go to the standard error stream once we're done
+  (see 'FinishDiagnostics'). If something goes badly wrong, we
+  still render every line before the problem, and report what we
+  found before it, then return false.
+*/
+YesNo CompileTSourceInPipeline(
+  // Where do we read the T source code from?
+  FILE *t_source,
+  // Where do we write the results?
+  FILE *output)
+{
+  static struct BlockRecycler recycler;
+  InitializeBlockRecycler(&recycler, max_pipeline_blocks_w);
+
+  static struct Pipeline pipeline;
+  pipeline = (struct Pipeline)
+  {
+    .t_source = t_source,
+    .recycler = &recycler,
+    .diagnostics_allocator = ReservedAllocator(max_diagnostics_w, false),
+    .enums_allocator = ReservedAllocator(max_enum_resolution_w, false)
+  };
+
+  pipeline.diagnostics = Diagnostics(&pipeline.diagnostics_allocator);
+  pipeline.enums = EnumResolution(&pipeline.enums_allocator);
+
+  InitializeRingBuffer(
+    &pipeline.line_batches,
+    pipeline.line_batch_slots,
+    pipeline_ring_slots_w);
+
+  InitializeRingBuffer(
+    &pipeline.token_batches,
+    pipeline.token_batch_slots,
+    pipeline_ring_slots_w);
+
+  atomic_init(&pipeline.stop_reading, false);
+
+  thrd_t reader;
+  thrd_t tokenizer;
+
+  if (thrd_create(&reader, ReadLineBatches, &pipeline) != thrd_success
+      || thrd_create(&tokenizer, TokenizeLineBatches, &pipeline)
+         != thrd_success)
+  {
+    ExitDueToError("The compiler couldn’t start a pipeline thread.\n");
+  }
+
+  // A NULL batch means there are no more batches.
+  struct TokenBatch *token_batch;
+  Size rendered_source_w = 0;
+
+  NameTraceThread("Rendering stage");
+  StartCountingPhase(RenderingPhase);
+
+  while ((token_batch = Pop(&pipeline.token_batches)) != NULL)
+  {
+    BeginTraceEvent("Render", NULL);
+    ResumeCounting();
+
+    rendered_source_w += token_batch->source_w;
+
+    for (Offset line_o = 0; line_o < token_batch->lines_w; line_o++)
+    {
+      Render(
+        &token_batch->lines[line_o],
+        token_batch->first_line_number + line_o,
+        output);
+    }
+
+    /*
+      The batch lives inside its allocator's memory, so we copy
+      the allocator out before giving that memory back.
+    */
+    auto allocator = token_batch->allocator;
+    RecycleEveryBlock(&allocator);
+
+    PauseCounting();
+    EndTraceEvent("Render", NULL);
+  }
+
+  StopCountingPhase(RenderingPhase, rendered_source_w);
+
+  thrd_join(reader, NULL);
+  thrd_join(tokenizer, NULL);
+
+  ReleaseRingBuffer(&pipeline.line_batches);
+  ReleaseRingBuffer(&pipeline.token_batches);
+
+  // (If tokenizing failed, the enum resolution is incomplete.)
+  if (pipeline.tokenizing_failed == false)
+  {
+    RenderEnumResolution(&pipeline.enums, output);
+  }
+
+  ReleaseReservedAllocator(&pipeline.enums_allocator);
+
+  // Either way, whatever we found before a failure still counts.
+  FinishDiagnostics(&pipeline.diagnostics);
+  ReleaseReservedAllocator(&pipeline.diagnostics_allocator);
+
+  return pipeline.tokenizing_failed == false;
+}
+
+
+/*
+  The reading stage: reads the T source into batches of whole
+  lines, and passes them along to the tokenizing stage.
+*/
+Integer ReadLineBatches(Memory pipeline_memory)
+{
+  struct Pipeline *pipeline = pipeline_memory;
+
+  /*
+    A batch ends after its last newline character. Whatever comes
+    after that starts the next batch, so we set it aside here.
+  */
+  Character carried_over[line_batch_text_w];
+  Size carried_over_w = 0;
+
+  // Are we partway through a line that's far too long?
+  YesNo skipping_long_line = false;
+
+  Offset next_line_number = 1;
+  YesNo at_end = false;
+  Size read_source_w = 0;
+
+  NameTraceThread("Reading stage");
+  StartCountingPhase(ReadingPhase);
+
+  while (at_end == false
+         && atomic_load(&pipeline->stop_reading) == false)
+  {
+    BeginTraceEvent("Read", NULL);
+    ResumeCounting();
+
+    auto block = TakeBlock(pipeline->recycler);
+    auto allocator = Allocator(block, recycled_block_w);
+
+    struct LineBatch *batch = TaggedAllocate(
+      &allocator,
+      sizeof *batch,
+      PipelineBatchAllocation);
+
+    Character *text = TaggedAllocate(
+      &allocator,
+      line_batch_text_w,
+      SourceTextAllocation);
+
+    memcpy(text, carried_over, carried_over_w);
+
+    auto space_w = line_batch_text_w - carried_over_w;
+    auto read_w =
+      fread(text + carried_over_w, 1, space_w, pipeline->t_source);
+
+    if (ferror(pipeline->t_source))
+    {
+      ExitDueToError("The compiler couldn’t read your source code.\n");
+    }
+
+    // If we read less than we asked for, we've reached the end.
+    at_end = read_w < space_w;
+    read_source_w += read_w;
+
+    auto text_w = carried_over_w + read_w;
+
+    /*
+      We already passed along the start of this line, which is
+      all the tokenizing stage looks at. We skip the rest of it,
+      newline and all, so it never turns up as a line of its own.
+    */
+    if (skipping_long_line)
+    {
+      Text newline = memchr(text, '\n', text_w);
+
+      if (newline == NULL)
+      {
+        text_w = 0;
+      }
+      else
+      {
+        auto skipped_w = (Size) (newline - text) + 1;
+        memmove(text, text + skipped_w, text_w - skipped_w);
+        text_w -= skipped_w;
+
+        skipping_long_line = false;
+      }
+    }
+
+    auto batch_text_w = text_w;
+
+    // Unless we've reached the end, find the last newline.
+    if (at_end == false)
+    {
+      auto newline_o = text_w;
+
+      while (newline_o > 0 && text[newline_o - 1] != '\n')
+      {
+        newline_o -= 1;
+      }
+
+      if (newline_o > 0)
+      {
+        batch_text_w = newline_o;
+      }
+      else if (text_w == line_batch_text_w)
+      {
+        /*
+          There's no newline at all, so the line is far too long.
+          We pass along its start anyway, and the tokenizing stage
+          complains. (See 'skipping_long_line'.)
+        */
+        skipping_long_line = true;
+      }
+      else
+      {
+        // The line isn't over yet. Let's wait for the rest of it.
+        batch_text_w = 0;
+      }
+    }
+
+    carried_over_w = text_w - batch_text_w;
+    memcpy(carried_over, text + batch_text_w, carried_over_w);
+
+    batch->first_line_number = next_line_number;
+    batch->lines = LineIndex(text, batch_text_w, &allocator);
+
+    /*
+      'LineIndex' skips a byte order mark at the start of the text.
+      After the first batch, though, that's just the start of an
+      ordinary line.
+    */
+    if (next_line_number > 1)
+    {
+      batch->lines.line_start_os[0] = 0;
+    }
+
+    next_line_number += batch->lines.lines_w;
+
+    PauseCounting();
+    EndTraceEvent("Read", NULL);
+
+    if (batch->lines.lines_w == 0)
+    {
+      RecycleBlock(pipeline->recycler, block);
+      continue;
+    }
+
+    Push(&pipeline->line_batches, batch);
+  }
+
+  StopCountingPhase(ReadingPhase, read_source_w);
+
+  // That's all, folks.
+  Push(&pipeline->line_batches, NULL);
+
+  return 0;
+}
+
+
+/*
+  The tokenizing stage: tokenizes each batch of lines, and passes
+  the results along to the rendering stage.
+
+  We stop early if we find too many errors (see 'TooManyErrors').
+*/
+Integer TokenizeLineBatches(Memory pipeline_memory)
+{
+  struct Pipeline *pipeline = pipeline_memory;
+
+  /*
+    If something goes badly wrong, 'ExitDueToError' writes the
+    error message, then jumps back here. The lines before the
+    problem still deserve to be rendered, so we send along what
+    we have.
+  */
+  struct ErrorRecovery recovery = { .error_stream = stderr };
+
+  if (setjmp(recovery.landing_spot) != 0)
+  {
+    RecoverFromErrors(NULL);
+    CollectDiagnostics(NULL);
+
+    // (We were probably counting, too.)
+    StopCountingPhase(TokenizingPhase, pipeline->tokenized_source_w);
+
+    pipeline->tokenizing_failed = true;
+
+    // (Unless we already passed them along.)
+    if (pipeline->current_token_batch != NULL)
+    {
+      Push(&pipeline->token_batches, pipeline->current_token_batch);
+    }
+
+    if (pipeline->current_line_batch != NULL)
+    {
+      RecycleBlock(pipeline->recycler, pipeline->current_line_batch);
+    }
+
+    // (If reading is already over, there's nothing to stop.)
+    if (pipeline->took_every_line_batch == false)
+    {
+      StopReading(pipeline);
+    }
+
+    Push(&pipeline->token_batches, NULL);
+
+    return 0;
+  }
+
+  RecoverFromErrors(&recovery);
+  CollectDiagnostics(&pipeline->diagnostics);
+
+  NameTraceThread("Tokenizing stage");
+  StartCountingPhase(TokenizingPhase);
+
+  struct LineBatch *line_batch;
+
+  while ((line_batch = Pop(&pipeline->line_batches)) != NULL)
+  {
+    BeginTraceEvent("Tokenize", NULL);
+    ResumeCounting();
+
+    pipeline->current_line_batch = line_batch;
+    pipeline->current_token_batch = NULL;
+
+    auto lines_w = line_batch->lines.lines_w;
+    auto allocator = RecyclingAllocator(pipeline->recycler);
+
+    // From here on, the batch's own allocator takes over.
+    struct TokenBatch *token_batch =
+      TaggedAllocate(
+        &allocator,
+        sizeof *token_batch,
+        PipelineBatchAllocation);
+
+    *token_batch = (struct TokenBatch)
+    {
+      .first_line_number = line_batch->first_line_number,
+      .source_w = line_batch->lines.source_w,
+      .lines = TaggedAllocate(
+        &allocator,
+        lines_w * sizeof (struct TokenizedLine),
+        TokenArrayAllocation)
+    };
+
+    // Room for every token the lines could possibly hold.
+    auto max_tokens_w = MaxTokensInLines(&line_batch->lines);
+
+    Text *token_slots = TaggedAllocate(
+      &allocator,
+      max_tokens_w * sizeof (Text),
+      TokenArrayAllocation);
+
+    Character *token_text = TaggedAllocate(
+      &allocator,
+      line_batch->lines.source_w + max_tokens_w,
+      TokenTextAllocation);
+
+    token_batch->allocator = allocator;
+    pipeline->current_token_batch = token_batch;
+
+    /*
+      Tokenize the whole batch in one go. Each line joins the
+      token batch as soon as it's done. (See
+      'LineTokenizedInPipeline'.)
+
+      If we find too many errors, we stop early.
+    */
+    TokenizeLines(
+      &line_batch->lines,
+      0,
+      lines_w,
+      line_batch->first_line_number,
+      token_batch->lines,
+      token_slots,
+      token_text,
+      LineTokenizedInPipeline,
+      pipeline);
+
+    pipeline->tokenized_source_w += line_batch->lines.source_w;
+
+    // The tokens are copies, so we're done with the source text.
+    RecycleBlock(pipeline->recycler, line_batch);
+    pipeline->current_line_batch = NULL;
+
+    PauseCounting();
+    EndTraceEvent("Tokenize", NULL);
+
+    // From here on, the token batch belongs to the rendering stage.
+    Push(&pipeline->token_batches, token_batch);
+    pipeline->current_token_batch = NULL;
+
+    if (TooManyErrors(&pipeline->diagnostics))
+    {
+      StopReading(pipeline);
+      break;
+    }
+  }
+
+  pipeline->took_every_line_batch = true;
+
+  // (If we gave up early, anything unfinished is no surprise.)
+  if (TooManyErrors(&pipeline->diagnostics) == false)
+  {
+    ResumeCounting();
+    FinishResolvingEnums(&pipeline->enums);
+    PauseCounting();
+  }
+
+  StopCountingPhase(TokenizingPhase, pipeline->tokenized_source_w);
+
+  RecoverFromErrors(NULL);
+  CollectDiagnostics(NULL);
+
+  // That's all, folks.
+  Push(&pipeline->token_batches, NULL);
+
+  return 0;
+}
+
+
+/*
+  (Tokenizing stage only.) 'TokenizeLines' has just tokenized one
+  more line of the current batch. We feed it to the enum
+  resolution pass, then count it as part of the token batch.
+
+  (If something goes badly wrong partway through the batch, the
+  lines we've counted still get rendered.)
+*/
+void LineTokenizedInPipeline(
+  const struct TokenizedLine *tokenized,
+  Offset line_number,
+  Memory pipeline_memory)
+{
+  struct Pipeline *pipeline = pipeline_memory;
+
+  ResolveEnums(&pipeline->enums, tokenized, line_number);
+
+  pipeline->current_token_batch->lines_w += 1;
+}
+
+
+/*
+  (Tokenizing stage only.) Asks the reading stage to stop, then
+  throws away whatever batches it already passed along.
+*/
+void StopReading(struct Pipeline *pipeline)
+{
+  atomic_store(&pipeline->stop_reading, true);
+
+  struct LineBatch *unwanted_batch;
+
+  while ((unwanted_batch = Pop(&pipeline->line_batches)) != NULL)
+  {
+    RecycleBlock(pipeline->recycler, unwanted_batch);
+  }
+}
@@ -0,0 +1,10 @@
+#ifndef pipelining_h_already_included
+#define pipelining_h_already_included
+
+#include "common_data_types.h"
+#include <stdio.h>
+
+
+YesNo CompileTSourceInPipeline(FILE *t_source, FILE *output);
+
+#endif
@@ -0,0 +1,254 @@
+#include "ring_buffer.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <threads.h>
+
+
+// How many times do we check again before giving up our turn?
+constexpr Size spins_before_yielding_w = 64;
+
+// And how many turns do we give up before going to sleep?
+constexpr Size yields_before_sleeping_w = 16;
+
+// What is a waiting thread waiting for?
+enum RingBufferWait
+{
+  WaitingForRoom,
+  WaitingForItem
+};
+
+
+void WaitPatiently(
+  struct RingBuffer *ring,
+  enum RingBufferWait wait,
+  Size *attempts_w);
+
+YesNo IsWaitOver(struct RingBuffer *ring, enum RingBufferWait wait);
+
+void WakeSleepers(struct RingBuffer *ring);
+
+
+// Prepares an empty ring buffer, provided its slots.
+void InitializeRingBuffer(
+  struct RingBuffer *ring,
+  Memory slots[],
+  // How many slots are there? (This must be a power of two.)
+  Size slots_w)
+{
+  if (slots_w == 0 || (slots_w & (slots_w - 1)) != 0)
+  {
+    ExitDueToError(
+      "A ring buffer can’t have %zu slots. "
+      "That’s not a power of two.\n",
+      slots_w);
+  }
+
+  atomic_init(&ring->oldest_o, 0);
+  atomic_init(&ring->just_after_newest_o, 0);
+  ring->slots = slots;
+  ring->slots_w = slots_w;
+
+  atomic_init(&ring->sleepers_w, 0);
+
+  if (mtx_init(&ring->mutex, mtx_plain) != thrd_success
+      || cnd_init(&ring->changed) != thrd_success)
+  {
+    ExitDueToError("The compiler couldn’t set up a ring buffer.\n");
+  }
+}
+
+
+// Cleans up after 'InitializeRingBuffer', once both threads are done.
+void ReleaseRingBuffer(struct RingBuffer *ring)
+{
+  cnd_destroy(&ring->changed);
+  mtx_destroy(&ring->mutex);
+}
+
+
+/*
+  (Producer only.) Adds an item to the ring buffer, unless it's
+  full. Returns whether we added it.
+*/
+YesNo TryPushing(struct RingBuffer *ring, Memory item)
+{
+  // Only we change this, so we don't need to be careful.
+  auto just_after_newest_o = atomic_load_explicit(
+    &ring->just_after_newest_o,
+    memory_order_relaxed);
+
+  // The consumer changes this.
+  auto oldest_o = atomic_load_explicit(
+    &ring->oldest_o,
+    memory_order_acquire);
+
+  if (just_after_newest_o - oldest_o == ring->slots_w)
+  {
+    return false;
+  }
+
+  ring->slots[just_after_newest_o & (ring->slots_w - 1)] = item;
+
+  /*
+    "Release" makes sure the consumer sees the item (and whatever
+    it points to) before it sees the updated offset.
+  */
+  atomic_store_explicit(
+    &ring->just_after_newest_o,
+    just_after_newest_o + 1,
+    memory_order_release);
+
+  return true;
+}
+
+
+/*
+  (Consumer only.) Removes the oldest item from the ring buffer,
+  unless it's empty. Returns whether we removed one.
+*/
+YesNo TryPopping(struct RingBuffer *ring, Memory *item)
+{
+  // Only we change this, so we don't need to be careful.
+  auto oldest_o = atomic_load_explicit(
+    &ring->oldest_o,
+    memory_order_relaxed);
+
+  // The producer changes this.
+  auto just_after_newest_o = atomic_load_explicit(
+    &ring->just_after_newest_o,
+    memory_order_acquire);
+
+  if (oldest_o == just_after_newest_o)
+  {
+    return false;
+  }
+
+  *item = ring->slots[oldest_o & (ring->slots_w - 1)];
+
+  // Let the producer know the slot is free again.
+  atomic_store_explicit(
+    &ring->oldest_o,
+    oldest_o + 1,
+    memory_order_release);
+
+  return true;
+}
+
+
+// (Producer only.) Adds an item, waiting for room if need be.
+void Push(struct RingBuffer *ring, Memory item)
+{
+  Size attempts_w = 0;
+
+  while (TryPushing(ring, item) == false)
+  {
+    WaitPatiently(ring, WaitingForRoom, &attempts_w);
+  }
+
+  WakeSleepers(ring);
+}
+
+
+// (Consumer only.) Removes the oldest item, waiting for one if
+// need be.
+Memory Pop(struct RingBuffer *ring)
+{
+  Size attempts_w = 0;
+  Memory item;
+
+  while (TryPopping(ring, &item) == false)
+  {
+    WaitPatiently(ring, WaitingForItem, &attempts_w);
+  }
+
+  WakeSleepers(ring);
+
+  return item;
+}
+
+
+/*
+  The other thread will be along shortly, so at first, we just
+  check again. If it's taking a while, we let other threads run.
+  (That matters a lot when there are fewer processors than
+  threads.) If it's taking ages, we sleep until it wakes us, so
+  an idle stage doesn't burn a processor.
+*/
+void WaitPatiently(
+  struct RingBuffer *ring,
+  enum RingBufferWait wait,
+  Size *attempts_w)
+{
+  *attempts_w += 1;
+
+  if (*attempts_w < spins_before_yielding_w)
+  {
+    return;
+  }
+
+  if (*attempts_w < spins_before_yielding_w + yields_before_sleeping_w)
+  {
+    thrd_yield();
+    return;
+  }
+
+  mtx_lock(&ring->mutex);
+
+  /*
+    We announce ourselves before checking one last time. The other
+    thread changes its offset before checking for sleepers, so
+    either we see its change, or it sees us (and then it can't
+    wake us until we're waiting, because we hold the mutex).
+  */
+  atomic_fetch_add(&ring->sleepers_w, 1);
+
+  while (IsWaitOver(ring, wait) == false)
+  {
+    cnd_wait(&ring->changed, &ring->mutex);
+  }
+
+  atomic_fetch_sub(&ring->sleepers_w, 1);
+
+  mtx_unlock(&ring->mutex);
+}
+
+
+// Is there room (or an item) for a waiting thread now?
+YesNo IsWaitOver(struct RingBuffer *ring, enum RingBufferWait wait)
+{
+  auto oldest_o = atomic_load(&ring->oldest_o);
+  auto just_after_newest_o = atomic_load(&ring->just_after_newest_o);
+
+  switch (wait)
+  {
+    case WaitingForRoom:
+      return just_after_newest_o - oldest_o != ring->slots_w;
+
+    case WaitingForItem:
+      return oldest_o != just_after_newest_o;
+  }
+
+  unreachable();
+}
+
+
+/*
+  We just changed our offset. If the other thread went to sleep
+  waiting for that, we wake it up.
+*/
+void WakeSleepers(struct RingBuffer *ring)
+{
+  // (This pairs with the sleeper announcing itself. See above.)
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (atomic_load_explicit(&ring->sleepers_w, memory_order_relaxed) == 0)
+  {
+    return;
+  }
+
+  mtx_lock(&ring->mutex);
+  cnd_broadcast(&ring->changed);
+  mtx_unlock(&ring->mutex);
+}
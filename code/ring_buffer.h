@@ -0,0 +1,59 @@
+#ifndef ring_buffer_h_already_included
+#define ring_buffer_h_already_included
+
+#include "common_data_types.h"
+#include <stdatomic.h>
+#include <threads.h>
+
+
+// Keeping these apart avoids "false sharing" between threads.
+constexpr Size cache_line_w = 64;
+
+/*
+  A bounded queue of pointers, passed from exactly one producer
+  thread to exactly one consumer thread. No locks required (unless
+  somebody falls asleep, see below)!
+
+  The producer only ever writes 'just_after_newest_o', and the
+  consumer only ever writes 'oldest_o'. Both keep counting up
+  forever; we wrap them around the slots with a bit mask, so the
+  capacity must be a power of two.
+
+  When the queue is full, the producer waits. That's what keeps
+  a fast producer from running away with all our memory. (Some
+  call this "back-pressure".)
+
+  Waiting starts out as spinning, but if the other thread takes
+  long enough, we go to sleep on 'changed' until it wakes us.
+  'sleepers_w' tells it whether anyone needs waking, so usually,
+  nobody touches the mutex at all.
+*/
+struct RingBuffer
+{
+  alignas(cache_line_w) atomic_size_t oldest_o;
+  alignas(cache_line_w) atomic_size_t just_after_newest_o;
+
+  alignas(cache_line_w) Memory *slots;
+  Size slots_w;
+
+  alignas(cache_line_w) atomic_size_t sleepers_w;
+  mtx_t mutex;
+  cnd_t changed;
+};
+
+void InitializeRingBuffer(
+  struct RingBuffer *ring,
+  Memory slots[],
+  Size slots_w);
+
+void ReleaseRingBuffer(struct RingBuffer *ring);
+
+YesNo TryPushing(struct RingBuffer *ring, Memory item);
+
+YesNo TryPopping(struct RingBuffer *ring, Memory *item);
+
+void Push(struct RingBuffer *ring, Memory item);
+
+Memory Pop(struct RingBuffer *ring);
+
+#endif
@@ -0,0 +1,472 @@
+#include "serving.h"
+#include "common_data_types.h"
+#include "compilation_cache.h"
+#include "compiling.h"
+#include "exit_due_to_error.h"
+#include "memory.h"
+#include "tokenizing.h"
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// A request header is a short keyword, a space, a path, and '\n'.
+constexpr Size max_request_header_w = 16 + PATH_MAX;
+
+/*
+  We serve one client at a time, so a client that goes quiet
+  would hold up everyone else. If it's quiet for this many
+  seconds, we give up on it.
+*/
+constexpr Size client_timeout_s = 10;
+
+
+struct sockaddr_un UnixSocketAddress(Text socket_path);
+
+void HandleCompileRequest(
+  Integer connection,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator,
+  struct CompilationCache *cache);
+
+YesNo SendResponse(
+  Integer connection,
+  YesNo succeeded,
+  Text body,
+  Size body_w);
+
+YesNo WriteFully(Integer file_descriptor, Text bytes, Size bytes_w);
+
+
+/*
+  Listens on the provided Unix domain socket and compiles
+  whatever we're asked to compile, forever.
+
+  Unlike a regular run of the compiler, we only pay our startup
+  costs once. Our allocators stay warm between requests, and we
+  remember the results of compiling each file until it changes.
+*/
+[[noreturn]] void ServeCompileRequests(Text socket_path)
+{
+  // If a client hangs up early, we'd rather have 'write' report
+  // an error than have the whole server killed by SIGPIPE.
+  signal(SIGPIPE, SIG_IGN);
+
+  auto address = UnixSocketAddress(socket_path);
+
+  // An earlier server might have left its socket behind. Let's
+  // clean it up. (We only ever remove sockets, never regular
+  // files!)
+  struct stat socket_status;
+  if (stat(socket_path, &socket_status) == 0
+      && S_ISSOCK(socket_status.st_mode))
+  {
+    unlink(socket_path);
+  }
+
+  auto listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (listener == -1)
+  {
+    ExitDueToError("The compiler couldn’t create a socket.\n");
+  }
+
+  if (bind(listener, (struct sockaddr *) &address, sizeof address) == -1
+      || listen(listener, SOMAXCONN) == -1)
+  {
+    ExitDueToError(
+      "The compiler couldn’t listen on this socket: '%s'\n",
+      socket_path);
+  }
+
+  // These allocators are reused by every request.
+  Byte tokenizing_memory[bytes_needed_to_tokenize_a_line];
+  auto tokenizing_allocator =
+    Allocator(tokenizing_memory, sizeof tokenizing_memory);
+
+  auto source_allocator = ReservedAllocator(max_t_source_w, false);
+
+  // So is this cache.
+  static struct CompilationCache cache;
+  InitializeCompilationCache(
+    &cache,
+    ReservedAllocator(default_compilation_cache_w, true));
+
+  fprintf(stderr, "Serving compile requests on '%s'\n", socket_path);
+
+  while (true)
+  {
+    auto connection = accept(listener, NULL, NULL);
+
+    // If a client gave up before we could accept it, or we were
+    // interrupted, let's just wait for the next one.
+    if (connection == -1)
+    {
+      continue;
+    }
+
+    // (Reading or writing fails once the client's too quiet.)
+    struct timeval timeout = { .tv_sec = client_timeout_s };
+
+    if (setsockopt(
+          connection,
+          SOL_SOCKET,
+          SO_RCVTIMEO,
+          &timeout,
+          sizeof timeout) == -1
+        || setsockopt(
+             connection,
+             SOL_SOCKET,
+             SO_SNDTIMEO,
+             &timeout,
+             sizeof timeout) == -1)
+    {
+      close(connection);
+      continue;
+    }
+
+    HandleCompileRequest(
+      connection,
+      &source_allocator,
+      &tokenizing_allocator,
+      &cache);
+  }
+}
+
+
+/*
+  Forwards a compile request to a server listening on the
+  provided socket, then writes the server's response just like a
+  regular run of the compiler would.
+
+  If the filename is "-", we forward the T source code from our
+  standard input instead.
+
+  Returns our program's exit status.
+*/
+Integer ForwardCompileRequest(Text socket_path, Text filename)
+{
+  auto address = UnixSocketAddress(socket_path);
+  auto connection = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (connection == -1
+      || connect(
+           connection,
+           (struct sockaddr *) &address,
+           sizeof address) == -1)
+  {
+    ExitDueToError(
+      "The compiler couldn’t reach a server on this socket: '%s'\n",
+      socket_path);
+  }
+
+  // This is big enough for reading and for writing.
+  Character buffer[4096];
+
+  if (strcmp(filename, "-") == 0)
+  {
+    // The T source code follows the request header.
+    YesNo sent = WriteFully(connection, "SOURCE\n", 7);
+
+    Size buffer_w;
+    while (sent && (buffer_w = fread(buffer, 1, sizeof buffer, stdin)) > 0)
+    {
+      sent = WriteFully(connection, buffer, buffer_w);
+    }
+
+    if (sent == false)
+    {
+      ExitDueToError("The compiler couldn’t send your source code.\n");
+    }
+  }
+  else
+  {
+    /*
+      The server probably has a different working directory than
+      we do, so we always send an absolute path.
+    */
+    Character absolute_filename[PATH_MAX];
+
+    if (realpath(filename, absolute_filename) == NULL)
+    {
+      ExitDueToError(
+        "The compiler couldn’t find your source file: '%s'\n",
+        filename);
+    }
+
+    if (dprintf(connection, "FILE %s\n", absolute_filename) < 0)
+    {
+      ExitDueToError("The compiler couldn’t send your request.\n");
+    }
+  }
+
+  // Let the server know our request is complete.
+  shutdown(connection, SHUT_WR);
+
+  auto response = fdopen(connection, "r");
+
+  if (response == NULL)
+  {
+    ExitDueToError("The compiler couldn’t read the response.\n");
+  }
+
+  // Read the response header.
+  Character status[8];
+  Size body_w;
+
+  if (fscanf(response, "%7s %zu", status, &body_w) != 2
+      || fgetc(response) != '\n')
+  {
+    ExitDueToError("The server sent a garbled response.\n");
+  }
+
+  auto succeeded = strcmp(status, "OK") == 0;
+
+  // Like a regular run, problems go to the standard error stream.
+  auto destination = succeeded ? stdout : stderr;
+
+  while (body_w > 0)
+  {
+    auto chunk_w = fread(
+      buffer,
+      1,
+      body_w < sizeof buffer ? body_w : sizeof buffer,
+      response);
+
+    if (chunk_w == 0)
+    {
+      ExitDueToError("The server hung up before it finished.\n");
+    }
+
+    fwrite(buffer, 1, chunk_w, destination);
+    body_w -= chunk_w;
+  }
+
+  fclose(response);
+
+  return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+// Returns the address of a Unix domain socket at the given path.
+struct sockaddr_un UnixSocketAddress(Text socket_path)
+{
+  struct sockaddr_un address = { .sun_family = AF_UNIX };
+
+  // We need room for the path's null terminator byte.
+  if (strlen(socket_path) >= sizeof address.sun_path)
+  {
+    ExitDueToError(
+      "This socket path is too long: '%s'\n",
+      socket_path);
+  }
+
+  strcpy(address.sun_path, socket_path);
+
+  return address;
+}
+
+
+/*
+  Reads one request from the connection, compiles what it asks
+  for, and sends back the response. Afterward, we close the
+  connection.
+
+  A broken request or a broken T source file only fails this
+  request. The server carries on.
+*/
+void HandleCompileRequest(
+  // The connection to our client.
+  Integer connection,
+  // Our warm, reusable allocators.
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator,
+  // Results of earlier compilations.
+  struct CompilationCache *cache)
+{
+  auto request = fdopen(connection, "r");
+
+  if (request == NULL)
+  {
+    close(connection);
+    return;
+  }
+
+  // Everything the compiler writes goes into this memory stream.
+  Character *result = NULL;
+  Size result_w = 0;
+  auto result_stream = open_memstream(&result, &result_w);
+
+  if (result_stream == NULL)
+  {
+    fclose(request);
+    return;
+  }
+
+  Character header[max_request_header_w];
+  auto outcome = CompilationFailed;
+
+  // If we've compiled the requested file before, this is it.
+  const struct CachedCompilation *cached_compilation = NULL;
+
+  if (fgets(header, sizeof header, request) == NULL)
+  {
+    fprintf(result_stream, "The request was empty.\n");
+  }
+  else if (strcmp(header, "SOURCE\n") == 0)
+  {
+    // The T source code follows the header.
+    outcome = CompileTSourceSafely(
+      request,
+      result_stream,
+      source_allocator,
+      tokenizing_allocator);
+  }
+  else if (strncmp(header, "FILE ", 5) == 0)
+  {
+    // Chop off the trailing newline.
+    header[strcspn(header, "\n")] = '\0';
+    auto filename = header + 5;
+
+    /*
+      We examine the very file we opened. (Examining the path,
+      then opening it again, could find a different file if it's
+      replaced in between. Then we'd remember the wrong result.)
+    */
+    auto t_source = fopen(filename, "r");
+    struct stat file_status;
+
+    if (t_source == NULL || fstat(fileno(t_source), &file_status) == -1)
+    {
+      fprintf(
+        result_stream,
+        "The compiler couldn’t open your source file: '%s'\n",
+        filename);
+    }
+    else
+    {
+      // Have we already compiled this version of the file?
+      cached_compilation =
+        CachedCompilation(cache, filename, &file_status);
+
+      if (cached_compilation == NULL)
+      {
+        outcome = CompileTSourceSafely(
+          t_source,
+          result_stream,
+          source_allocator,
+          tokenizing_allocator);
+
+        // Flushing the memory stream updates 'result' and
+        // 'result_w'.
+        fflush(result_stream);
+
+        CacheCompilation(
+          cache,
+          filename,
+          &file_status,
+          result,
+          result_w,
+          outcome == CompilationSucceeded);
+      }
+    }
+
+    if (t_source != NULL)
+    {
+      fclose(t_source);
+    }
+  }
+  else
+  {
+    fprintf(result_stream, "Unrecognized request: %s\n", header);
+  }
+
+  // Closing the memory stream finalizes 'result' and 'result_w'.
+  fclose(result_stream);
+
+  if (cached_compilation != NULL)
+  {
+    SendResponse(
+      connection,
+      cached_compilation->succeeded,
+      cached_compilation->result,
+      cached_compilation->result_w);
+  }
+  else
+  {
+    SendResponse(
+      connection,
+      outcome == CompilationSucceeded,
+      result,
+      result_w);
+  }
+
+  free(result);
+
+  // This closes the connection, too.
+  fclose(request);
+}
+
+
+/*
+  Sends a response header, followed by the response body.
+
+  Returns false if the client hung up.
+*/
+YesNo SendResponse(
+  Integer connection,
+  YesNo succeeded,
+  Text body,
+  Size body_w)
+{
+  Character header[32];
+  auto header_w = snprintf(
+    header,
+    sizeof header,
+    "%s %zu\n",
+    succeeded ? "OK" : "ERROR",
+    body_w);
+
+  return
+       WriteFully(connection, header, header_w)
+    && WriteFully(connection, body, body_w);
+}
+
+
+/*
+  The 'write' function might write fewer bytes than we asked it
+  to. This function keeps writing until every byte is written.
+
+  Returns false if something went wrong.
+*/
+YesNo WriteFully(Integer file_descriptor, Text bytes, Size bytes_w)
+{
+  while (bytes_w > 0)
+  {
+    auto written_w = write(file_descriptor, bytes, bytes_w);
+
+    if (written_w == -1)
+    {
+      // If we were interrupted, let's try again.
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      return false;
+    }
+
+    bytes += written_w;
+    bytes_w -= written_w;
+  }
+
+  return true;
+}
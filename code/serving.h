@@ -0,0 +1,30 @@
+#ifndef serving_h_already_included
+#define serving_h_already_included
+
+#include "common_data_types.h"
+
+
+/*
+  "t --serve" turns the compiler into a long-lived process that
+  listens on a Unix domain socket. "t --client" forwards a
+  compile request to it.
+
+  Each connection carries exactly one request, followed by
+  exactly one response.
+
+  A request is one of:
+    "FILE /absolute/path/to/source.t\n"
+    "SOURCE\n" followed by the T source code itself. (The client
+      shuts down its side of the connection to mark the end.)
+
+  A response is one of:
+    "OK <byte count>\n" followed by the compiler's output.
+    "ERROR <byte count>\n" followed by the compiler's output,
+      including the error message.
+*/
+
+[[noreturn]] void ServeCompileRequests(Text socket_path);
+
+Integer ForwardCompileRequest(Text socket_path, Text filename);
+
+#endif
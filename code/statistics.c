@@ -0,0 +1,62 @@
+#include "statistics.h"
+#include "allocation_tracing.h"
+#include "block_recycling.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+#include "kernels.h"
+#include "line_memo.h"
+#include "performance_counters.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+// When did we start collecting statistics?
+static struct timespec start_time;
+
+
+void ReportStatistics();
+
+
+/*
+  From now on, we keep track of how the compiler's doing. When the
+  program exits, we report what we found to the standard error
+  stream.
+*/
+void StartCollectingStatistics()
+{
+  timespec_get(&start_time, TIME_UTC);
+
+  // Where we can, we count hardware events, too.
+  StartCountingHardwareEvents();
+
+  if (atexit(ReportStatistics) != 0)
+  {
+    ExitDueToError("The compiler couldn’t arrange to report statistics.\n");
+  }
+}
+
+
+// Reports our statistics. (We call this on our way out.)
+void ReportStatistics()
+{
+  struct timespec end_time;
+  timespec_get(&end_time, TIME_UTC);
+
+  auto elapsed_ms =
+    (end_time.tv_sec - start_time.tv_sec) * 1000.0
+    + (end_time.tv_nsec - start_time.tv_nsec) / 1'000'000.0;
+
+  fprintf(stderr, "Statistics:\n");
+  fprintf(stderr, "  Kernels: %s\n", ActiveKernels()->name);
+  fprintf(stderr, "  Time: %.3f ms\n", elapsed_ms);
+
+  ReportHardwareEvents(stderr);
+  ReportLineMemo(stderr);
+  ReportBlockRecycling(stderr);
+
+#if defined(T_TRACE_ALLOCATIONS)
+  // (Only if the compiler was built with allocation tracing.)
+  ReportAllocations(stderr);
+#endif
+}
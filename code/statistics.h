@@ -0,0 +1,7 @@
+#ifndef statistics_h_already_included
+#define statistics_h_already_included
+
+
+void StartCollectingStatistics();
+
+#endif
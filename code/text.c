@@ -2,6 +2,7 @@
 #include "common_data_types.h"
 #include "memory.h"
 #include "exit_due_to_error.h"
+#include <string.h>
 
 
 // This returns a snippet of text.
@@ -13,7 +14,9 @@ Text CopyTextSnippet(
   // The offset immediately following the final character to copy.
   Offset just_after_snippet_end_o,
   // Our trusty allocator!
-  struct Allocator *allocator)
+  struct Allocator *allocator,
+  // What's the snippet for? (See 'AllocationTag'.)
+  enum AllocationTag tag)
 {
   // Where is the snippet we'll be copying?
   auto copy_from = source + snippet_start_o;
@@ -22,12 +25,18 @@ Text CopyTextSnippet(
   auto snippet_w =
     just_after_snippet_end_o - snippet_start_o;
 
-  // Copy it.
+  /*
+    We add 1 to accommodate the trailing '\0'. (Asking for it all
+    at once matters: a recycling allocator might not put a second
+    allocation right after the first.)
+  */
   OverwritableText copied_snippet =
-    AllocateCopy(allocator, (Memory) copy_from, snippet_w);
+    TaggedAllocate(allocator, snippet_w + 1, tag);
+
+  // Copy it.
+  memcpy(copied_snippet, copy_from, snippet_w);
 
   // The cherry on top! Let's add the null terminator byte.
-  Allocate(allocator, 1);
   copied_snippet[snippet_w] = '\0';
 
   return copied_snippet;
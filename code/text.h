@@ -19,7 +19,8 @@ Text CopyTextSnippet(
   Text source,
   Offset snippet_start_o,
   Offset just_after_snippet_end_o,
-  struct Allocator *allocator);
+  struct Allocator *allocator,
+  enum AllocationTag tag);
 
 enum UTF8CharacterWidth UTF8CharacterWidth(
   CharacterBundle character_bundle);
@@ -1,34 +1,181 @@
 #include "tokenizing.h"
 #include "common_data_types.h"
-#include "exit_due_to_error.h"
-#include "memory.h"
+#include "diagnostics.h"
+#include "kernels.h"
+#include "line_index.h"
 #include "text.h"
 #include <stddef.h>
+#include <string.h>
 
 
+struct TokenizedLine TokenizeOneLine(
+  Character line_buffer[static max_line_length],
+  Size line_number,
+  const struct KernelSet *kernels,
+  Text token_slots[],
+  Character token_text[],
+  Size *token_text_w);
+
+Text CopyToken(
+  Text line_buffer,
+  Offset token_start_o,
+  Offset just_after_token_end_o,
+  Character token_text[],
+  Size *token_text_w);
+
+void CopyIndexedLine(
+  const struct LineIndex *lines,
+  Offset line_o,
+  Character line_buffer[]);
+
 YesNo IsWhitespaceOrCommentary(UTFCodepoint codepoint);
 
+Character FoldedFullwidthCharacter(
+  CharacterBundle character_bundle,
+  enum UTF8CharacterWidth character_bundle_w);
+
+
+// Are we folding fullwidth characters? (See
+// 'FoldFullwidthCharacters'.)
+static YesNo folds_fullwidth_characters = false;
+
+/*
+  Which ASCII character does each fullwidth character fold into?
+  (0 means it doesn't fold.)
+
+  Every fullwidth character we fold is 3 bytes wide in UTF-8:
+  0xEF, then 0xBC or 0xBD, then one more byte. The low bit of the
+  second byte and the low 6 bits of the third byte are all we
+  need to look it up. (See 'FoldedFullwidthCharacter'.)
+*/
+static Character fullwidth_folds[128];
+
+// An indexed line might be far too long. We only copy as much of
+// it as the tokenizer needs to notice. (See 'CopyIndexedLine'.)
+constexpr Size max_copied_line_w =
+  max_line_length * utf8_max_character_width;
+
+
+/*
+  Tokenizes many lines of an indexed source text in one go, one
+  after another. (0 is the first line.)
+
+  We don't allocate anything. Instead, we fill in the caller's
+  buffers:
+
+    - 'tokenized_lines' gets one record per line.
+    - 'token_slots' gets every line's tokens, one line after
+      another. (Each record points to its own line's tokens.)
+    - 'token_text' gets the text of every token, each with its
+      trailing '\0'.
+
+  'MaxTokensInLines' says how big the buffers need to be.
+
+  If the caller provides a 'line_tokenized' function, we call it
+  with each line as soon as it's tokenized, before we move on to
+  the next. (That way, any diagnostics it reports stay in order.)
+
+  Setting up the tokenizer once, instead of once per line, makes
+  this quicker than tokenizing each line by itself.
+
+  Returns how many lines we tokenized. That's all of them, unless
+  this thread collects diagnostics (see 'CollectDiagnostics') and
+  found too many errors along the way. Then we stop early.
+*/
+Size TokenizeLines(
+  const struct LineIndex *lines,
+  // Which lines do we tokenize?
+  Offset first_line_o,
+  Size lines_w,
+  // What's the number of the first line? (For diagnostics.)
+  Offset first_line_number,
+  // Where do we write the results?
+  struct TokenizedLine tokenized_lines[],
+  Text token_slots[],
+  Character token_text[],
+  // (This can be NULL.)
+  LineTokenized line_tokenized,
+  Memory context)
+{
+  auto kernels = ActiveKernels();
+
+  // We add 1 to accommodate the trailing '\0'.
+  Character line_buffer[1 + max_copied_line_w];
+
+  Size token_slots_w = 0;
+  Size token_text_w = 0;
+  Offset line_o = 0;
+
+  for (; line_o < lines_w && CollectedTooManyErrors() == false; line_o++)
+  {
+    CopyIndexedLine(lines, first_line_o + line_o, line_buffer);
+
+    auto tokenized = TokenizeOneLine(
+      line_buffer,
+      first_line_number + line_o,
+      kernels,
+      &token_slots[token_slots_w],
+      token_text,
+      &token_text_w);
+
+    token_slots_w += tokenized.tokens_w;
+    tokenized_lines[line_o] = tokenized;
+
+    if (line_tokenized != NULL)
+    {
+      line_tokenized(
+        &tokenized_lines[line_o],
+        first_line_number + line_o,
+        context);
+    }
+  }
+
+  return line_o;
+}
+
 
 /*
-  This constructor produces a TokenizedLine, given a line of code
-  and an allocator.
+  How many tokens could these lines hold, at most? That's how many
+  token slots 'TokenizeLines' might need for them.
 
-  To keep things beautifully simple, if we encounter any syntax
-  errors, we report the error to the standard error stream, then
-  we safely exit the program.
+  It might need this many bytes of token text, plus the width of
+  the lines' source text.
 
-  TODO: Cleanly ignore the (optional) trailing newline character.
+  (Tokens are separated by at least 1 byte, so a line that's N
+  bytes wide holds at most (N + 1) / 2 tokens.)
 */
-struct TokenizedLine TokenizedLine(
+Size MaxTokensInLines(const struct LineIndex *lines)
+{
+  return (lines->source_w + lines->lines_w) / 2;
+}
+
+
+/*
+  Tokenizes a single line for 'TokenizeLines'.
+
+  If we encounter any syntax errors, we report them (see
+  'ReportDiagnostic'), then carry on as best we can.
+
+  The line's tokens go into the provided slots. (There's room for
+  as many as the line could hold, but not necessarily for
+  'max_tokens_per_line'.) Their text goes into 'token_text',
+  starting at 'token_text_w', which we advance past the text we
+  write.
+*/
+struct TokenizedLine TokenizeOneLine(
   // A character buffer starting with our null-terminated line.
   Character line_buffer[static max_line_length],
   // Which line are we on?
   Size line_number,
-  // Our trusty allocator.
-  struct Allocator *allocator)
+  // (See 'ActiveKernels'.)
+  const struct KernelSet *kernels,
+  // Where do the tokens go?
+  Text token_slots[],
+  Character token_text[],
+  Size *token_text_w)
 {
   // Every token we find goes here.
-  OverwritableText code_tokens[max_tokens_per_line];
+  auto code_tokens = token_slots;
 
   // How many tokens have we found?
   Size code_tokens_w = 0;
@@ -53,18 +200,73 @@ struct TokenizedLine TokenizedLine(
   // If we're within a code token, where did it begin?
   Offset token_start_o = 0;
 
-  // Which character are we examining?
-  Character character;
+  /*
+    When we fold a fullwidth character (see
+    'FoldFullwidthCharacters'), it shrinks from 3 bytes to 1. So
+    everything after it slides down to fill the gap, as we go.
+
+    Where does the next character we keep land? (Without folding,
+    that's right where it already is.)
+  */
+  Offset landing_o = 0;
+
+  /*
+    Before we start, let's make sure the line is valid UTF-8. Then
+    we can decode its characters without worrying.
 
-  // "If this character isn't the null terminator byte..."
-  while ('\0' != (character = line_buffer[next_character_o]))
+    If it isn't, we only tokenize the part before the problem.
+  */
+  auto line_w = strlen(line_buffer);
+  auto valid_w = kernels->ValidUTF8Width(line_buffer, line_w);
+
+  if (valid_w < line_w)
   {
-    auto character_bundle = &character;
-    auto character_bundle_w = UTF8CharacterWidth(character_bundle);
+    ReportDiagnostic(
+      DiagnosticError,
+      line_number,
+      ColumnNumber(line_buffer, valid_w),
+      "This line isn’t valid UTF-8.");
+
+    line_w = valid_w;
+  }
+
+  /*
+    Which bytes are spaces, tabs, plain ASCII code, or parts of
+    wider characters? (We never look past the maximum line
+    length.)
+  */
+  Byte byte_classes[max_line_length];
+  auto classified_w = (line_w < max_line_length) ? line_w : max_line_length;
+
+  kernels->ClassifyBytes(line_buffer, classified_w, byte_classes);
+
+  // "While we haven't reached the end of the line..."
+  while (next_character_o < line_w)
+  {
+    // Which character are we examining?
+    Character character = line_buffer[next_character_o];
 
     // Let's save the offset of the current character. We might
     // need this later.
     auto character_o = next_character_o;
+    auto character_class = byte_classes[character_o];
+
+    // Plain ASCII characters are a single byte wide. Anything
+    // else, we need to decode.
+    auto character_bundle = &line_buffer[character_o];
+    enum UTF8CharacterWidth character_bundle_w = OneByteWide;
+    Character folded_character = '\0';
+
+    if (character_class == MultibyteByte)
+    {
+      character_bundle_w = UTF8CharacterWidth(character_bundle);
+
+      if (folds_fullwidth_characters)
+      {
+        folded_character =
+          FoldedFullwidthCharacter(character_bundle, character_bundle_w);
+      }
+    }
 
     /*
       With that saved, let's advance our character offset by the
@@ -76,20 +278,68 @@ struct TokenizedLine TokenizedLine(
     */
     next_character_o += character_bundle_w;
 
+    /*
+      If the line is too long, we pretend it ends right before
+      this character.
+    */
     if (next_character_o >= max_line_length)
     {
-      ExitDueToError(
-        "Line number: %zu\n"
-        "The maximum line length is %i.\n",
+      ReportDiagnostic(
+        DiagnosticError,
         line_number,
+        ColumnNumber(line_buffer, landing_o),
+        "The maximum line length is %zu.",
         max_line_length);
+
+      break;
     }
 
-    auto character_codepoint =
-      UTF8Codepoint(character_bundle, character_bundle_w);
+    UTFCodepoint character_codepoint = (Byte) character;
+    auto is_character_chinese = false;
+    auto is_whitespace_or_commentary = (character_class != CodeByte);
 
-    auto is_character_chinese =
-      IsUTFCodepointChinese(character_codepoint);
+    if (folded_character != '\0')
+    {
+      // (Every character we fold into is plain ASCII code.)
+      character_codepoint = (Byte) folded_character;
+      is_whitespace_or_commentary = false;
+    }
+    else if (character_class == MultibyteByte)
+    {
+      character_codepoint =
+        UTF8Codepoint(character_bundle, character_bundle_w);
+
+      is_character_chinese =
+        IsUTFCodepointChinese(character_codepoint);
+
+      is_whitespace_or_commentary =
+        IsWhitespaceOrCommentary(character_codepoint);
+    }
+
+    /*
+      Now that we've examined the current character, let's move it
+      to where it lands. (We couldn't do that any sooner: sliding
+      it down might overwrite its own bytes.)
+    */
+    auto character_landing_o = landing_o;
+
+    if (folded_character != '\0')
+    {
+      line_buffer[landing_o] = folded_character;
+      landing_o += 1;
+    }
+    else
+    {
+      if (landing_o != character_o)
+      {
+        memmove(
+          &line_buffer[landing_o],
+          character_bundle,
+          character_bundle_w);
+      }
+
+      landing_o += character_bundle_w;
+    }
 
     // If we're still calculating the indent level...
     if (CalculateIndentLevel == goal)
@@ -135,12 +385,13 @@ struct TokenizedLine TokenizedLine(
           if ((spaces_of_indentation_w % 2) == 1)
           {
             // This line is indented with an odd number of
-            // spaces. That's a mistake.
-            ExitDueToError(
-              "Line number: %zu\n"
+            // spaces. That's a mistake. (We'll round down.)
+            ReportDiagnostic(
+              DiagnosticError,
+              line_number,
+              1,
               "The indent level of this line is %zu spaces. "
               "It must be a multiple of two.",
-              line_number,
               spaces_of_indentation_w);
           }
         }
@@ -152,7 +403,7 @@ struct TokenizedLine TokenizedLine(
       level.
     */
 
-    if (IsWhitespaceOrCommentary(character_codepoint) == true)
+    if (is_whitespace_or_commentary == true)
     {
       switch (goal)
       {
@@ -169,14 +420,15 @@ struct TokenizedLine TokenizedLine(
           //  of code, and here it is.
 
           // Let's copy it...
-          auto token = CopyTextSnippet(
+          auto token = CopyToken(
             line_buffer,
             token_start_o,
-            character_o,
-            allocator);
+            character_landing_o,
+            token_text,
+            token_text_w);
 
           // ... and make it official!
-          code_tokens[code_tokens_w] = (OverwritableText) token;
+          code_tokens[code_tokens_w] = token;
           code_tokens_w += 1;
 
           goal = FindStartOfNextToken;
@@ -209,7 +461,7 @@ struct TokenizedLine TokenizedLine(
       {
         // We've found the start of the next token. Let's record
         // it...
-        token_start_o = character_o;
+        token_start_o = character_landing_o;
         // ... and switch gears.
         goal = FindEndOfCurrentToken;
 
@@ -223,25 +475,25 @@ struct TokenizedLine TokenizedLine(
 
   // (Here, we're outside the main loop.)
 
-  // If we were in the middle of a token when we reached the null
-  // terminator byte...
+  // If we were in the middle of a token when we reached the end
+  // of the line...
   if (FindEndOfCurrentToken == goal)
   {
     // ...then let's collect the token and head home.
 
-    // We know 'next_character_o' points just past the end of the
-    // line.
-    auto just_after_token_end = next_character_o;
+    // We know 'landing_o' points just past the end of the line.
+    auto just_after_token_end = landing_o;
 
     // Extract the token...
-    auto code_token = CopyTextSnippet(
+    auto code_token = CopyToken(
       line_buffer,
       token_start_o,
       just_after_token_end,
-      allocator);
+      token_text,
+      token_text_w);
 
     // ... and make it official!
-    code_tokens[code_tokens_w] = (OverwritableText) code_token;
+    code_tokens[code_tokens_w] = code_token;
     code_tokens_w += 1;
 
     // Show that we're finished with the final token.
@@ -258,6 +510,19 @@ struct TokenizedLine TokenizedLine(
       return (struct TokenizedLine) {};
     }
 
+    // (We don't handle quotations yet.)
+    case FindEndOfQuotation:
+    {
+      ReportDiagnostic(
+        DiagnosticError,
+        line_number,
+        ColumnNumber(line_buffer, landing_o),
+        "Line ended in the middle of a quotation.");
+
+      // Let's keep the tokens we did find.
+      [[fallthrough]];
+    }
+
     // If we're looking for the start of the next token...
     case FindStartOfNextToken:
     {
@@ -267,24 +532,11 @@ struct TokenizedLine TokenizedLine(
       {
         .indent_level = spaces_of_indentation_w / 2,
         .tokens_w = code_tokens_w,
-        // We aren't copying tokens' text; we're copying pointers
-        // to those pieces of text.
-        .tokens = AllocateCopy(
-          allocator,
-          code_tokens,
-          code_tokens_w * sizeof code_tokens[0]),
+        // (The tokens are already where they belong.)
+        .tokens = code_tokens
       };
     }
 
-    // (We don't handle quotations yet.)
-    case FindEndOfQuotation:
-    {
-      ExitDueToError(
-        "Line number: %zu\n"
-        "Line ended in the middle of a quotation.\n",
-        line_number);
-    }
-
     // (We handled this directly before this current 'switch'.)
     case FindEndOfCurrentToken: unreachable();
   }
@@ -293,6 +545,62 @@ struct TokenizedLine TokenizedLine(
 }
 
 
+/*
+  Copies a token's text from the line into 'token_text', at
+  'token_text_w', and adds a trailing '\0'. Returns the copy.
+*/
+Text CopyToken(
+  Text line_buffer,
+  Offset token_start_o,
+  Offset just_after_token_end_o,
+  Character token_text[],
+  Size *token_text_w)
+{
+  auto token_w = just_after_token_end_o - token_start_o;
+  auto token = &token_text[*token_text_w];
+
+  memcpy(token, &line_buffer[token_start_o], token_w);
+  token[token_w] = '\0';
+
+  *token_text_w += token_w + 1;
+
+  return token;
+}
+
+
+/*
+  Copies one line of an indexed source text into a little buffer,
+  null-terminated, ready for 'TokenizeOneLine'.
+
+  If the line is too long, the tokenizer reports it. We only copy
+  as much as it needs to notice.
+*/
+void CopyIndexedLine(
+  const struct LineIndex *lines,
+  Offset line_o,
+  // (This needs room for 1 + 'max_copied_line_w' bytes.)
+  Character line_buffer[])
+{
+  auto line = Line(lines, line_o);
+  auto line_w = LineWidth(lines, line_o);
+
+  if (line_w > max_copied_line_w)
+  {
+    line_w = max_copied_line_w;
+
+    // Let's not cut a character in half, though.
+    while (line_w > 0
+           && (((const Byte*) line)[line_w] & 0b1100'0000) == 0b1000'0000)
+    {
+      line_w -= 1;
+    }
+  }
+
+  memcpy(line_buffer, line, line_w);
+  line_buffer[line_w] = '\0';
+}
+
+
 /*
   Does this codepoint represent either whitespace or commentary,
   as far as T's rules are concerned?
@@ -307,3 +615,64 @@ YesNo IsWhitespaceOrCommentary(UTFCodepoint codepoint)
     // Is it commentary?
     || IsUTFCodepointChinese(codepoint);
 }
+
+
+/*
+  From now on, the tokenizer folds fullwidth ASCII characters
+  (U+FF01 to U+FF5E) into their ASCII equivalents: '：' becomes
+  ':', 'Ａ' becomes 'A', and so on.
+
+  (Otherwise, some of them count as commentary. See
+  'IsUTFCodepointChinese'.)
+
+  We fold as we tokenize, so it doesn't cost an extra pass over
+  the line. (Call this before starting any threads.)
+*/
+void FoldFullwidthCharacters()
+{
+  constexpr UTFCodepoint first_fullwidth_codepoint = 0xFF01;
+  constexpr UTFCodepoint last_fullwidth_codepoint = 0xFF5E;
+
+  // Each fullwidth character is exactly this far from its ASCII
+  // equivalent.
+  constexpr UTFCodepoint fullwidth_distance = 0xFEE0;
+
+  for (auto codepoint = first_fullwidth_codepoint;
+       codepoint <= last_fullwidth_codepoint;
+       codepoint++)
+  {
+    // (The low 7 bits of the codepoint match the table offset.
+    // See 'fullwidth_folds'.)
+    fullwidth_folds[codepoint & 0x7F] =
+      (Character) (codepoint - fullwidth_distance);
+  }
+
+  folds_fullwidth_characters = true;
+}
+
+
+/*
+  If this is a fullwidth ASCII character, which ASCII character
+  does it fold into? Returns '\0' if it doesn't fold.
+
+  (We look it up directly from its bytes. No decoding required!)
+*/
+Character FoldedFullwidthCharacter(
+  CharacterBundle character_bundle,
+  enum UTF8CharacterWidth character_bundle_w)
+{
+  auto bytes = (const Byte*) character_bundle;
+
+  if (character_bundle_w != ThreeBytesWide
+      || bytes[0] != 0xEF
+      || (bytes[1] != 0xBC && bytes[1] != 0xBD))
+  {
+    return '\0';
+  }
+
+  auto fold_o =
+    (bytes[1] & 0b0000'0001) << 6
+    | (bytes[2] & 0b0011'1111);
+
+  return fullwidth_folds[fold_o];
+}
@@ -2,6 +2,7 @@
 #define tokenizing_h_already_included
 
 #include "common_data_types.h"
+#include "line_index.h"
 #include "memory.h"
 #include "text.h"
 
@@ -53,15 +54,39 @@ struct TokenizedLine
 constexpr Size max_line_length = 120;
 constexpr Size max_tokens_per_line = max_line_length / 2;
 
+// The text of a line's tokens, each with its trailing '\0', is
+// never wider than this.
+constexpr Size max_token_text_per_line_w =
+  max_line_length + max_tokens_per_line;
+
 constexpr Size bytes_needed_to_tokenize_a_line =
   // Memory needed for the pointers to the text of the tokens
   (max_tokens_per_line * pointer_width)
   // Memory needed for the actual text of the tokens
-  + (max_line_length * utf8_max_character_width) + 1;
+  + max_token_text_per_line_w;
+
+/*
+  'TokenizeLines' hands each line to one of these as soon as it's
+  tokenized, along with the provided context.
+*/
+typedef void (*LineTokenized)(
+  const struct TokenizedLine *tokenized,
+  Offset line_number,
+  Memory context);
+
+Size TokenizeLines(
+  const struct LineIndex *lines,
+  Offset first_line_o,
+  Size lines_w,
+  Offset first_line_number,
+  struct TokenizedLine tokenized_lines[],
+  Text token_slots[],
+  Character token_text[],
+  LineTokenized line_tokenized,
+  Memory context);
+
+Size MaxTokensInLines(const struct LineIndex *lines);
 
-struct TokenizedLine TokenizedLine(
-  Character line_buffer[max_line_length],
-  Size line_buffer_w,
-  struct Allocator *allocator);
+void FoldFullwidthCharacters();
 
 #endif
@@ -0,0 +1,671 @@
+#include "watching.h"
+#include "common_data_types.h"
+#include "exit_due_to_error.h"
+
+#if defined(__linux__)
+
+#include "compilation_cache.h"
+#include "compiling.h"
+#include "memory.h"
+#include "text.h"
+#include "tokenizing.h"
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+
+constexpr Size max_watched_directories = 256;
+constexpr Size max_watched_files = 1024;
+constexpr Size max_changed_files_per_round = 1024;
+
+/*
+  Editors often save a file with a quick burst of writes and
+  renames. After the first change, we wait until things have been
+  quiet for this many milliseconds before we recompile anything.
+*/
+constexpr Integer debounce_milliseconds = 20;
+
+/*
+  The inotify events we care about: a file was written then
+  closed, or a file was moved into place. (Many editors save by
+  writing a temporary file, then renaming it.)
+*/
+constexpr uint32_t watched_events = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+/*
+  We always watch directories, never individual files. That way,
+  we still notice a file that's replaced by a rename.
+*/
+struct WatchedDirectory
+{
+  Integer watch_descriptor;
+  Text path;
+
+  // Do we recompile every T source file within this directory,
+  // or only the specific files we've been asked to watch?
+  YesNo watches_every_t_file;
+};
+
+// A specific file we've been asked to watch.
+struct WatchedFile
+{
+  Offset directory_o;
+  Text name;
+};
+
+struct Watchlist
+{
+  Integer inotify;
+
+  struct WatchedDirectory directories[max_watched_directories];
+  Size directories_w;
+
+  struct WatchedFile files[max_watched_files];
+  Size files_w;
+
+  // Directory paths and filenames live here.
+  struct Allocator allocator;
+};
+
+// The files that changed during this round.
+struct ChangedFiles
+{
+  struct WatchedFile files[max_changed_files_per_round];
+  Size files_w;
+
+  // Filenames live here.
+  struct Allocator allocator;
+};
+
+
+void WatchPath(
+  struct Watchlist *watchlist,
+  struct ChangedFiles *changed,
+  Text path);
+
+Offset WatchDirectory(
+  struct Watchlist *watchlist,
+  Text path,
+  YesNo watches_every_t_file);
+
+void NoteEveryWatchedFile(
+  const struct Watchlist *watchlist,
+  struct ChangedFiles *changed);
+
+void NoteEveryTSourceFile(
+  const struct Watchlist *watchlist,
+  Offset directory_o,
+  struct ChangedFiles *changed);
+
+void NoteChangedFile(
+  struct ChangedFiles *changed,
+  Offset directory_o,
+  Text name);
+
+void WaitForChanges(
+  const struct Watchlist *watchlist,
+  struct ChangedFiles *changed);
+
+void CollectChanges(
+  const struct Watchlist *watchlist,
+  struct ChangedFiles *changed);
+
+YesNo IsWatched(
+  const struct Watchlist *watchlist,
+  Offset directory_o,
+  Text name);
+
+YesNo IsTSourceFilename(Text name);
+
+void RecompileChangedFiles(
+  const struct Watchlist *watchlist,
+  const struct ChangedFiles *changed,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator,
+  struct CompilationCache *cache);
+
+
+/*
+  Compiles everything we've been asked to watch, then recompiles
+  whatever changes, forever.
+
+  Between rounds, we remember the results of compiling each file
+  (along with the file's size and modification time). If a file
+  is "saved" without actually changing, we don't recompile it.
+*/
+[[noreturn]] void WatchAndRecompile(Text paths[], Size paths_w)
+{
+  static struct Watchlist watchlist;
+  static struct ChangedFiles changed;
+
+  // These allocators only use the memory they actually need.
+  watchlist.allocator =
+    ReservedAllocator(max_watched_files * PATH_MAX, false);
+
+  changed.allocator =
+    ReservedAllocator(max_changed_files_per_round * NAME_MAX, false);
+
+  auto source_allocator = ReservedAllocator(max_t_source_w, false);
+
+  // Create our tokenizing allocator using blazing-fast stack
+  // memory.
+  Byte tokenizing_memory[bytes_needed_to_tokenize_a_line];
+  auto tokenizing_allocator =
+    Allocator(tokenizing_memory, sizeof tokenizing_memory);
+
+  static struct CompilationCache cache;
+  InitializeCompilationCache(
+    &cache,
+    ReservedAllocator(default_compilation_cache_w, true));
+
+  watchlist.inotify = inotify_init1(IN_CLOEXEC);
+
+  if (watchlist.inotify == -1)
+  {
+    ExitDueToError("The compiler couldn’t start watching files.\n");
+  }
+
+  // Start watching. Everything we watch needs compiling once.
+  for (Offset i = 0; i < paths_w; i++)
+  {
+    WatchPath(&watchlist, &changed, paths[i]);
+  }
+
+  while (true)
+  {
+    RecompileChangedFiles(
+      &watchlist,
+      &changed,
+      &source_allocator,
+      &tokenizing_allocator,
+      &cache);
+
+    // Forget this round's changes.
+    changed.files_w = 0;
+    ResetAllocator(&changed.allocator);
+
+    WaitForChanges(&watchlist, &changed);
+  }
+}
+
+
+/*
+  Starts watching either a single T source file or a directory of
+  T source files. Either way, we note that it needs compiling.
+*/
+void WatchPath(
+  struct Watchlist *watchlist,
+  struct ChangedFiles *changed,
+  Text path)
+{
+  struct stat path_status;
+
+  if (stat(path, &path_status) == -1)
+  {
+    ExitDueToError(
+      "The compiler couldn’t find this file or directory: '%s'\n",
+      path);
+  }
+
+  if (S_ISDIR(path_status.st_mode))
+  {
+    auto directory_o = WatchDirectory(watchlist, path, true);
+    NoteEveryTSourceFile(watchlist, directory_o, changed);
+    return;
+  }
+
+  if (watchlist->files_w == max_watched_files)
+  {
+    ExitDueToError(
+      "The compiler can only watch %zu files.\n",
+      max_watched_files);
+  }
+
+  // Split the path into its directory and its filename.
+  Text last_slash = strrchr(path, '/');
+  Text directory_path = ".";
+  Text name = path;
+
+  if (last_slash != NULL)
+  {
+    // (If the file lives in the root directory, we keep "/".)
+    Offset just_after_directory_o =
+      (last_slash == path) ? 1 : (Offset) (last_slash - path);
+
+    directory_path = CopyTextSnippet(
+      path,
+      0,
+      just_after_directory_o,
+      &watchlist->allocator,
+      WatchingAllocation);
+
+    name = last_slash + 1;
+  }
+
+  auto directory_o =
+    WatchDirectory(watchlist, directory_path, false);
+
+  watchlist->files[watchlist->files_w] = (struct WatchedFile)
+  {
+    .directory_o = directory_o,
+    .name = CopyTextSnippet(
+      name,
+      0,
+      strlen(name),
+      &watchlist->allocator,
+      WatchingAllocation)
+  };
+
+  watchlist->files_w += 1;
+
+  NoteChangedFile(changed, directory_o, name);
+}
+
+
+/*
+  Starts watching a directory, unless we're already watching it.
+
+  Returns the directory's offset within our watchlist.
+*/
+Offset WatchDirectory(
+  struct Watchlist *watchlist,
+  Text path,
+  YesNo watches_every_t_file)
+{
+  auto watch_descriptor =
+    inotify_add_watch(watchlist->inotify, path, watched_events);
+
+  if (watch_descriptor == -1)
+  {
+    ExitDueToError(
+      "The compiler couldn’t watch this directory: '%s'\n",
+      path);
+  }
+
+  // If we're already watching this directory, inotify hands us
+  // the same watch descriptor again.
+  for (Offset i = 0; i < watchlist->directories_w; i++)
+  {
+    auto directory = &watchlist->directories[i];
+
+    if (directory->watch_descriptor == watch_descriptor)
+    {
+      directory->watches_every_t_file |= watches_every_t_file;
+      return i;
+    }
+  }
+
+  if (watchlist->directories_w == max_watched_directories)
+  {
+    ExitDueToError(
+      "The compiler can only watch %zu directories.\n",
+      max_watched_directories);
+  }
+
+  watchlist->directories[watchlist->directories_w] =
+    (struct WatchedDirectory)
+    {
+      .watch_descriptor = watch_descriptor,
+      .path = CopyTextSnippet(
+        path,
+        0,
+        strlen(path),
+        &watchlist->allocator,
+        WatchingAllocation),
+      .watches_every_t_file = watches_every_t_file
+    };
+
+  watchlist->directories_w += 1;
+
+  return watchlist->directories_w - 1;
+}
+
+
+/*
+  Notes that everything we're watching needs recompiling. (We do
+  this if inotify tells us it dropped some events.)
+*/
+void NoteEveryWatchedFile(
+  const struct Watchlist *watchlist,
+  struct ChangedFiles *changed)
+{
+  for (Offset i = 0; i < watchlist->files_w; i++)
+  {
+    auto file = &watchlist->files[i];
+    NoteChangedFile(changed, file->directory_o, file->name);
+  }
+
+  for (Offset i = 0; i < watchlist->directories_w; i++)
+  {
+    if (watchlist->directories[i].watches_every_t_file)
+    {
+      NoteEveryTSourceFile(watchlist, i, changed);
+    }
+  }
+}
+
+
+// Notes that every T source file in this directory needs
+// compiling.
+void NoteEveryTSourceFile(
+  const struct Watchlist *watchlist,
+  Offset directory_o,
+  struct ChangedFiles *changed)
+{
+  auto directory_path = watchlist->directories[directory_o].path;
+  auto directory = opendir(directory_path);
+
+  if (directory == NULL)
+  {
+    ExitDueToError(
+      "The compiler couldn’t read this directory: '%s'\n",
+      directory_path);
+  }
+
+  struct dirent *entry;
+
+  while ((entry = readdir(directory)) != NULL)
+  {
+    if (IsTSourceFilename(entry->d_name))
+    {
+      NoteChangedFile(changed, directory_o, entry->d_name);
+    }
+  }
+
+  closedir(directory);
+}
+
+
+// Notes that this file needs recompiling, unless we already know.
+void NoteChangedFile(
+  struct ChangedFiles *changed,
+  Offset directory_o,
+  Text name)
+{
+  for (Offset i = 0; i < changed->files_w; i++)
+  {
+    auto file = &changed->files[i];
+
+    if (file->directory_o == directory_o
+        && strcmp(file->name, name) == 0)
+    {
+      return;
+    }
+  }
+
+  if (changed->files_w == max_changed_files_per_round)
+  {
+    ExitDueToError(
+      "More than %zu files changed at once.\n",
+      max_changed_files_per_round);
+  }
+
+  changed->files[changed->files_w] = (struct WatchedFile)
+  {
+    .directory_o = directory_o,
+    .name = CopyTextSnippet(
+      name,
+      0,
+      strlen(name),
+      &changed->allocator,
+      WatchingAllocation)
+  };
+
+  changed->files_w += 1;
+}
+
+
+/*
+  Waits for at least one watched file to change. Then we keep
+  collecting changes until things quiet down.
+*/
+void WaitForChanges(
+  const struct Watchlist *watchlist,
+  struct ChangedFiles *changed)
+{
+  struct pollfd inotify = {
+    .fd = watchlist->inotify,
+    .events = POLLIN
+  };
+
+  // Wait as long as it takes for the first relevant change...
+  while (changed->files_w == 0)
+  {
+    if (poll(&inotify, 1, -1) > 0)
+    {
+      CollectChanges(watchlist, changed);
+    }
+  }
+
+  // ...then keep collecting until things have been quiet for a
+  // moment.
+  while (poll(&inotify, 1, debounce_milliseconds) > 0)
+  {
+    CollectChanges(watchlist, changed);
+  }
+}
+
+
+// Reads the pending inotify events, noting any relevant changes.
+void CollectChanges(
+  const struct Watchlist *watchlist,
+  struct ChangedFiles *changed)
+{
+  // This buffer must be aligned just like an inotify event.
+  alignas(struct inotify_event) Byte events[64 * 1024];
+
+  auto events_w = read(watchlist->inotify, events, sizeof events);
+
+  if (events_w <= 0)
+  {
+    return;
+  }
+
+  for (Offset event_o = 0; event_o < (Offset) events_w;)
+  {
+    auto event = (const struct inotify_event *) (events + event_o);
+    event_o += sizeof (struct inotify_event) + event->len;
+
+    // Did inotify drop some events? Then anything might have
+    // changed.
+    if (event->mask & IN_Q_OVERFLOW)
+    {
+      NoteEveryWatchedFile(watchlist, changed);
+      continue;
+    }
+
+    // Every event we care about names a file.
+    if (event->len == 0)
+    {
+      continue;
+    }
+
+    // Which of our directories is this event about?
+    for (Offset i = 0; i < watchlist->directories_w; i++)
+    {
+      if (watchlist->directories[i].watch_descriptor == event->wd)
+      {
+        if (IsWatched(watchlist, i, event->name))
+        {
+          NoteChangedFile(changed, i, event->name);
+        }
+
+        break;
+      }
+    }
+  }
+}
+
+
+// Are we watching the file with this name in this directory?
+YesNo IsWatched(
+  const struct Watchlist *watchlist,
+  Offset directory_o,
+  Text name)
+{
+  if (watchlist->directories[directory_o].watches_every_t_file
+      && IsTSourceFilename(name))
+  {
+    return true;
+  }
+
+  for (Offset i = 0; i < watchlist->files_w; i++)
+  {
+    auto file = &watchlist->files[i];
+
+    if (file->directory_o == directory_o
+        && strcmp(file->name, name) == 0)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+// Does this filename end in ".t"?
+YesNo IsTSourceFilename(Text name)
+{
+  auto name_w = strlen(name);
+
+  return name_w > 2 && strcmp(name + name_w - 2, ".t") == 0;
+}
+
+
+/*
+  Recompiles every file that changed this round, writing each
+  file's results under a little header.
+*/
+void RecompileChangedFiles(
+  const struct Watchlist *watchlist,
+  const struct ChangedFiles *changed,
+  struct Allocator *source_allocator,
+  struct Allocator *tokenizing_allocator,
+  struct CompilationCache *cache)
+{
+  struct timespec started;
+  clock_gettime(CLOCK_MONOTONIC, &started);
+
+  Size recompiled_w = 0;
+
+  for (Offset i = 0; i < changed->files_w; i++)
+  {
+    auto file = &changed->files[i];
+    auto directory_path =
+      watchlist->directories[file->directory_o].path;
+
+    // Files in the current directory keep their short names.
+    Character path[PATH_MAX];
+
+    if (strcmp(directory_path, ".") == 0)
+    {
+      snprintf(path, sizeof path, "%s", file->name);
+    }
+    else
+    {
+      snprintf(path, sizeof path, "%s/%s", directory_path, file->name);
+    }
+
+    /*
+      We examine the very file we opened, then compile that same
+      file. (Examining the path, then opening it again, could find
+      a different file if it's replaced in between. Then we'd
+      remember the wrong result.)
+    */
+    auto t_source = fopen(path, "r");
+
+    // The file might have been removed or renamed away since.
+    if (t_source == NULL)
+    {
+      continue;
+    }
+
+    struct stat file_status;
+
+    // If the file didn't actually change, we're done with it.
+    if (fstat(fileno(t_source), &file_status) == -1
+        || CachedCompilation(cache, path, &file_status) != NULL)
+    {
+      fclose(t_source);
+      continue;
+    }
+
+    // Everything the compiler writes goes into this memory stream.
+    Character *result = NULL;
+    Size result_w = 0;
+    auto result_stream = open_memstream(&result, &result_w);
+
+    if (result_stream == NULL)
+    {
+      ExitDueToError("The compiler couldn’t open a memory stream.\n");
+    }
+
+    auto outcome = CompileTSourceSafely(
+      t_source,
+      result_stream,
+      source_allocator,
+      tokenizing_allocator);
+
+    fclose(t_source);
+
+    // Closing the memory stream finalizes 'result' and 'result_w'.
+    fclose(result_stream);
+
+    CacheCompilation(
+      cache,
+      path,
+      &file_status,
+      result,
+      result_w,
+      outcome == CompilationSucceeded);
+
+    // Like a regular run, problems go to the standard error
+    // stream.
+    auto destination =
+      (outcome == CompilationSucceeded) ? stdout : stderr;
+
+    fprintf(destination, "==> %s <==\n", path);
+    fwrite(result, 1, result_w, destination);
+    fflush(destination);
+
+    free(result);
+    recompiled_w += 1;
+  }
+
+  if (recompiled_w > 0)
+  {
+    struct timespec finished;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    auto elapsed_ms =
+        (finished.tv_sec - started.tv_sec) * 1000.0
+      + (finished.tv_nsec - started.tv_nsec) / 1000000.0;
+
+    fprintf(
+      stderr,
+      "Recompiled %zu file(s) in %.3f ms.\n",
+      recompiled_w,
+      elapsed_ms);
+  }
+}
+
+
+#else
+
+
+// Without inotify, we can't watch anything.
+[[noreturn]] void WatchAndRecompile(Text paths[], Size paths_w)
+{
+  ExitDueToError("Watch mode relies on Linux’s inotify.\n");
+}
+
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef watching_h_already_included
+#define watching_h_already_included
+
+#include "common_data_types.h"
+
+
+/*
+  "t --watch <file or directory>..." compiles the given T source
+  files (and every T source file within the given directories),
+  then waits for them to change. Whenever they do, we recompile
+  just the files that changed.
+
+  This relies on Linux's inotify.
+*/
+[[noreturn]] void WatchAndRecompile(Text paths[], Size paths_w);
+
+#endif
@@ -1,18 +1,103 @@
+#include "code/batch_compiling.h"
 #include "code/common_data_types.h"
+#include "code/compiling.h"
+#include "code/diagnostics.h"
+#include "code/event_tracing.h"
 #include "code/exit_due_to_error.h"
+#include "code/kernels.h"
 #include "code/tokenizing.h"
 #include "code/memory.h"
+#include "code/pipelining.h"
+#include "code/serving.h"
+#include "code/statistics.h"
+#include "code/watching.h"
 #include <stdio.h>
-
-
-// C requires us to announce a function's definition before we’re
-// allowed to use the function.
-void Render(const struct TokenizedLine *tokenized, Offset line_number);
+#include <stdlib.h>
+#include <string.h>
 
 
 // Our program starts here.
 Integer main(Integer argument_count, Text arguments[])
 {
+  /*
+    Options come right after the program's name:
+
+      "--kernel=<name>" picks which kernels to use (see
+      'KernelSet'), instead of the best ones for this processor.
+
+      "--stats" reports statistics once we're done, including
+      hardware events (like cycles and cache misses) during each
+      phase, if the processor and the kernel allow it.
+
+      "--max-errors=<N>" gives up after N errors, instead of the
+      default. (0 means "never give up".)
+
+      "--fold-fullwidth" reads fullwidth ASCII characters, like
+      '：', as their ASCII equivalents. (See
+      'FoldFullwidthCharacters'.)
+
+      "--trace=<file>" records when each phase begins and ends, on
+      each thread and for each file, then writes the timeline to
+      that file for Perfetto or "about:tracing". (See
+      'StartTracingEvents'.)
+
+    Once we've read them, we skip past them, as if they were never
+    there.
+  */
+  Size options_w = 0;
+
+  for (; 1 + options_w < (Size) argument_count; options_w++)
+  {
+    auto option = arguments[1 + options_w];
+
+    if (strncmp(option, "--kernel=", strlen("--kernel=")) == 0)
+    {
+      UseKernels(option + strlen("--kernel="));
+    }
+    else if (strcmp(option, "--stats") == 0)
+    {
+      StartCollectingStatistics();
+    }
+    else if (strncmp(option, "--max-errors=", strlen("--max-errors=")) == 0)
+    {
+      auto number = option + strlen("--max-errors=");
+      Character *just_after_number;
+      auto max_errors_w = strtoull(number, &just_after_number, 10);
+
+      if (*number < '0' || *number > '9' || *just_after_number != '\0')
+      {
+        ExitDueToError("Usage: t --max-errors=<N> ...\n");
+      }
+
+      LimitErrors(max_errors_w);
+    }
+    else if (strcmp(option, "--fold-fullwidth") == 0)
+    {
+      FoldFullwidthCharacters();
+    }
+    else if (strncmp(option, "--trace=", strlen("--trace=")) == 0)
+    {
+      auto trace_filename = option + strlen("--trace=");
+
+      if (*trace_filename == '\0')
+      {
+        ExitDueToError("Usage: t --trace=<file> ...\n");
+      }
+
+      StartTracingEvents(trace_filename);
+    }
+    else
+    {
+      break;
+    }
+  }
+
+  arguments += options_w;
+  argument_count -= options_w;
+
+  // Let's pick our kernels now, before we start any threads.
+  ActiveKernels();
+
   // The first argument is always the name of the program. Any
   // user-specified arguments follow it.
   if (argument_count == 1)
@@ -20,13 +105,55 @@ Integer main(Integer argument_count, Text arguments[])
     ExitDueToError("You need to specify a T source file.\n");
   }
 
-  // For now, we only accept a single user-specified argument:
-  // the T source file.
+  /*
+    "t --serve <socket>" keeps the compiler running, waiting for
+    compile requests on a Unix domain socket.
+
+    "t --client <socket> <T source file>" forwards a request to
+    that server. (A source file of "-" means "standard input".)
+  */
+  if (strcmp(arguments[1], "--serve") == 0)
+  {
+    if (argument_count != 3)
+    {
+      ExitDueToError("Usage: t --serve <socket>\n");
+    }
+
+    ServeCompileRequests(arguments[2]);
+  }
+
+  if (strcmp(arguments[1], "--client") == 0)
+  {
+    if (argument_count != 4)
+    {
+      ExitDueToError("Usage: t --client <socket> <T source file>\n");
+    }
+
+    return ForwardCompileRequest(arguments[2], arguments[3]);
+  }
+
+  /*
+    "t --watch <file or directory>..." recompiles T source files
+    whenever they change.
+  */
+  if (strcmp(arguments[1], "--watch") == 0)
+  {
+    if (argument_count < 3)
+    {
+      ExitDueToError("Usage: t --watch <file or directory>...\n");
+    }
+
+    WatchAndRecompile(arguments + 2, argument_count - 2);
+  }
+
+  // Given several T source files, we compile them all at once.
   if (argument_count > 2)
   {
-    ExitDueToError("You provided too many arguments.\n");
+    return CompileTSourceFiles(arguments + 1, argument_count - 1);
   }
 
+  YesNo compiled;
+
   /*
     Q: Why are we introducing a new scope, demarcated by { ... }?
 
@@ -36,7 +163,10 @@ Integer main(Integer argument_count, Text arguments[])
   */
   FILE *t_source_file; {
     auto filename = arguments[1];
+
+    BeginTraceEvent("Open", filename);
     t_source_file = fopen(filename, "r");
+    EndTraceEvent("Open", filename);
 
     // Did we manage to open the file?
     if (t_source_file == NULL)
@@ -47,76 +177,19 @@ Integer main(Integer argument_count, Text arguments[])
         filename);
     }
 
-    constexpr Size max_bytes_per_line =
-      max_line_length * utf8_max_character_width;
-
-    // We add 2 to accommodate a trailing '\n' and '\0'.
-    Character line_buffer[2 + max_bytes_per_line];
     /*
-      The 'fgets' function always appends '\0' to the line, so we
-      always need room for that byte.
-
-      Usually, the line buffer includes the trailing '\n', too,
-      but this character is missing in two situations:
-
-      1. If final line of the source file doesn't end with a
-         newline character, 'fgets' won't append one.
-
-      2. If any given line is longer than our buffer, 'fgets'
-         truncates the line to make sure it fits. This chops off
-         the newline character.
-
-      We always make extra room for both the '\n' and '\0'. If
-      'fgets' completely fills this "expanded" buffer without
-      including a newline character, the line was longer than we
-      allow.
+      Compile the file, line by line. Reading, tokenizing and
+      rendering each get their own thread.
     */
-
-    // Which line are we currently tokenizing?
-    Offset line_number = 1;
-
-    while (fgets(line_buffer, sizeof line_buffer, t_source_file))
-    {
-      // Create our allocator using blazing-fast stack memory.
-      Byte allocator_memory[bytes_needed_to_tokenize_a_line];
-      /*
-        Q: Why do we create a new allocator each loop iteration?
-
-        A: Right now, we don't need to preserve any data between
-           iterations. Once we do, we'll need to use an allocator
-           that is preserved between iterations, too.
-      */
-      auto allocator =
-        Allocator(allocator_memory, sizeof allocator_memory);
-
-      // Tokenize the current line.
-      auto tokenized_line =
-        TokenizedLine(line_buffer, line_number, &allocator);
-
-      // Render the result!
-      Render(&tokenized_line, line_number);
-
-      // Ever onward.
-      line_number += 1;
-    }
+    compiled = CompileTSourceInPipeline(t_source_file, stdout);
   } fclose(t_source_file);
 
+  if (compiled == false)
+  {
+    return EXIT_FAILURE;
+  }
+
   // Could we pretend that this 0 m
   return 0;
 }
 
-
-// Render a tokenized line for debug purposes.
-void Render(
-  const struct TokenizedLine *tokenized,
-  Offset line_number)
-{
-  printf("Line #%zu\n", line_number);
-  printf("  Indent level: %zu\n", tokenized->indent_level);
-  printf("  Token count: %zu\n", tokenized->tokens_w);
-
-  for (Offset i = 0; i < tokenized->tokens_w; i++)
-  {
-    printf("    %s\n", tokenized->tokens[i]);
-  }
-}
@@ -0,0 +1,22 @@
+这个例子混合了全角标点、全角空格和中文注释。
+enum Ｓｅａｓｏｎ
+{
+　Ｓｐｒｉｎｇ　春天
+　Summer　夏天、很热。
+  Ａｕｔｕｍｎ　秋天
+  Winter 冬天
+}
+
+Text Greeting（Ｓｅａｓｏｎ）
+{
+　return switch （ｓｅａｓｏｎ）
+  {
+  　Ｓｐｒｉｎｇ： '春天好'
+  　Summer: '夏天好'
+  　Ａｕｔｕｍｎ： '秋天好'
+  　Winter： '冬天好'
+  }
+}
+
+下一行太长了。折叠前后、错误的列号都一样。
+Text Ｓｅａｓｏｎｓ（）：ｓｐｒｉｎｇ，ｓｕｍｍｅｒ，ａｕｔｕｍｎ，ｗｉｎｔｅｒ，ａｎｄ　ｓｐｒｉｎｇ
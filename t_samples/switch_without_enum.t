@@ -0,0 +1,24 @@
+Text DigitName(Integer)
+{
+  return switch (digit)
+  {
+    0: 'zero'
+    1: 'one'
+    default: 'many'
+  }
+}
+
+Text Weekday(Day)
+{
+  return switch (day)
+  {
+    Monday: 'Back to work.'
+    Friday: 'Almost there.'
+  }
+}
+
+enum Day
+{
+  Monday
+  Friday
+}